@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include "bench.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+
+uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+bench_stats* bench_create(void)
+{
+    // shared with the forked producers and consumers, anonymous pages are already zeroed
+    bench_stats *stats = mmap(NULL, sizeof(bench_stats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED)
+    {
+        perror("Mmap bench stats error");
+        exit(EXIT_FAILURE);
+    }
+    return stats;
+}
+
+void bench_destroy(bench_stats *stats)
+{
+    munmap(stats, sizeof(bench_stats));
+}
+
+// log-linear buckets: 16 linear steps inside every power of two, about 6% resolution
+static int latency_bucket(uint64_t ns)
+{
+    if (ns < BENCH_SUB_BUCKETS)
+        return (int)ns;
+
+    int msb = 63 - __builtin_clzll(ns);
+    int group = msb - 3;
+    int sub = (int)((ns >> (msb - 4)) & (BENCH_SUB_BUCKETS - 1));
+    return group * BENCH_SUB_BUCKETS + sub;
+}
+
+static uint64_t bucket_value(int bucket)
+{
+    int group = bucket / BENCH_SUB_BUCKETS;
+    int sub = bucket % BENCH_SUB_BUCKETS;
+
+    if (group == 0)
+        return (uint64_t)sub;
+    return (uint64_t)(BENCH_SUB_BUCKETS + sub) << (group - 1);
+}
+
+void bench_record(bench_counters *counters, const message *msg, uint64_t now, int lane)
+{
+    uint64_t latency = (now > msg->send_time) ? now - msg->send_time : 0;
+
+    counters->received++;
+    counters->bytes += msg->size;
+    counters->latency[lane][latency_bucket(latency)]++;
+}
+
+static uint64_t percentile(const uint64_t *latency, uint64_t total, double fraction)
+{
+    uint64_t rank = (uint64_t)(fraction * (double)total);
+    uint64_t seen = 0;
+
+    if (rank >= total)
+        rank = total - 1;
+
+    for (int i = 0; i < BENCH_BUCKETS; i++)
+    {
+        seen += latency[i];
+        if (seen > rank)
+            return bucket_value(i);
+    }
+    return bucket_value(BENCH_BUCKETS - 1);
+}
+
+static void print_latency(const char *name, const uint64_t *latency)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < BENCH_BUCKETS; i++)
+    {
+        total += latency[i];
+    }
+
+    if (total == 0)
+        return;
+
+    printf("  %s latency ns: p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64 ", p99.9 %" PRIu64 ", max %" PRIu64 " (%" PRIu64 " msgs)\n",
+        name, percentile(latency, total, 0.50), percentile(latency, total, 0.90),
+        percentile(latency, total, 0.99), percentile(latency, total, 0.999),
+        percentile(latency, total, 1.0), total);
+}
+
+void bench_report(const bench_stats *stats, const char *label, int producers, int consumers, int lanes, double seconds)
+{
+    static uint64_t latency[MAX_LANES + 1][BENCH_BUCKETS];
+    uint64_t sent = 0, received = 0, bytes = 0, invalid = 0;
+    char name[16];
+
+    // the last row is the sum over all lanes
+    memset(latency, 0, sizeof(latency));
+    for (int i = 0; i < BENCH_MAX_SLOTS; i++)
+    {
+        const bench_counters *c = &stats->slots[i];
+        sent += c->sent;
+        received += c->received;
+        bytes += c->bytes;
+        invalid += c->invalid;
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            for (int j = 0; j < BENCH_BUCKETS; j++)
+            {
+                latency[lane][j] += c->latency[lane][j];
+                latency[MAX_LANES][j] += c->latency[lane][j];
+            }
+        }
+    }
+
+    printf("\n[%s] producers: %d, consumers: %d, duration: %.2f s\n", label, producers, consumers, seconds);
+    printf("  sent: %" PRIu64 ", received: %" PRIu64 ", invalid hash: %" PRIu64 "\n", sent, received, invalid);
+    printf("  throughput: %.0f msg/s, %.2f MB/s\n", received / seconds, bytes / seconds / (1024.0 * 1024.0));
+
+    print_latency("all", latency[MAX_LANES]);
+    if (lanes == 1)
+        return;
+
+    for (int lane = 0; lane < lanes; lane++)
+    {
+        snprintf(name, sizeof(name), "lane %d", lane);
+        print_latency(name, latency[lane]);
+    }
+}
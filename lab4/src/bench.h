@@ -0,0 +1,38 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#include "message.h"
+#include "ring_buffer.h"
+
+#define BENCH_MAX_SLOTS 100
+#define BENCH_SUB_BUCKETS 16
+#define BENCH_BUCKETS (64 * BENCH_SUB_BUCKETS)
+
+// one slot per process, aligned so producers and consumers never share a cache line
+typedef struct
+{
+    _Alignas(64) uint64_t sent;
+    uint64_t received;
+    uint64_t bytes;
+    uint64_t invalid;
+    uint64_t latency[MAX_LANES][BENCH_BUCKETS];
+} bench_counters;
+
+typedef struct
+{
+    bench_counters slots[BENCH_MAX_SLOTS];
+} bench_stats;
+
+uint64_t bench_now_ns(void);
+
+bench_stats* bench_create(void);
+
+void bench_destroy(bench_stats *stats);
+
+void bench_record(bench_counters *counters, const message *msg, uint64_t now, int lane);
+
+void bench_report(const bench_stats *stats, const char *label, int producers, int consumers, int lanes, double seconds);
+
+#endif
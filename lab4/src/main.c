@@ -3,32 +3,59 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>  
-#include <sys/sem.h>
-#include <sys/ipc.h>
+#include <semaphore.h>
 #include <signal.h>
+#include <sched.h>
+#include <errno.h>
 #include <time.h>
 #include <ctype.h>
 #include <string.h>
+#include <inttypes.h>
+#include <limits.h>
 
 #include "ring_buffer.h"
 #include "message.h"
+#include "bench.h"
 
-#define SEM_KEY 0x5678
 #define MAX_COMMAND_LEN 16
 #define MAX_PROCESSES_COUNT 100
+#define CONSUME_BATCH_SIZE 4
+#define MAX_QUEUE_SIZE (1 << 24)
+#define MAX_SHARDS 64
+#define STEAL_POLL_NS 1000000
+#define BACKOFF_SPINS 100
+#define BACKOFF_YIELDS 200
+#define BACKOFF_SLEEP_NS 50000
+#define DEFAULT_SYNC_INTERVAL_MS 100
 
 void termination_handler(int signum);  
 void delay(void);  
 void read_command(char *buffer);  
+void parse_args(int argc, char *argv[], int *capacity, queue_backing *backing, int *backing_set);  
 void init_semaphores(void);  
-void wait_semaphore(int sem_num);  
-void signal_semaphore(int sem_num);  
+void destroy_semaphores(void);  
+int wait_semaphore(message_queue *q, int sem_num);  
+int timed_wait_semaphore(message_queue *q, int sem_num, long timeout_ns);  
+int try_wait_semaphore(message_queue *q, int sem_num);  
+void signal_semaphore(message_queue *q, int sem_num);  
+void signal_semaphore_n(message_queue *q, int sem_num, int n);  
+message_queue* reserve_ring(const message *msg);  
+void lane_order(message_queue *shard, int *order);  
+void check_message(const message *msg, message_queue *q);  
+void consume_own_shard(message_queue *shard);  
+int steal_work(message_queue *own);  
+void backoff(int *spins);  
+int wait_gating(uint64_t seq);  
 void producer_process(void);  
 void consumer_process(void);  
+void subscriber_process(void);  
+void start_syncer(void);  
+void stop_syncer(void);  
 void create_process(const char process_type);  
 void print_processes(void);  
 void kill_process(int index);  
 void cleanup_and_exit(void); 
+void run_benchmark(int capacity, queue_backing backing);
 
 typedef enum
 {
@@ -44,8 +71,6 @@ typedef enum
 } process_type;
 char *process_type_arr[2] = { "consumer", "producer" };
 
-int sem_id = 0;
-int shm_id = 0;
 message_queue* queue = NULL;
 
 pid_t processes[MAX_PROCESSES_COUNT] = { 0 }; 
@@ -54,6 +79,32 @@ int processes_count = 0;
 
 volatile sig_atomic_t terminate_flag = 0;
 
+// benchmark mode: no delays, no per-message output, counters go to the shared stats
+bench_stats *bench = NULL;
+bench_counters *bench_slot = NULL;
+int bench_seconds = 0;
+int bench_producers = 1;
+int bench_consumers = 1;
+
+// sharded layout: consumer n owns shard n % queue_shards, producers spread by round robin or by type
+int queue_shards = 1;
+int distribute_by_type = 0;
+int process_ordinal = 0;
+int next_shard = 0;
+
+// priority lanes: lane 0 first, either strictly or by smooth weighted round robin (weight 2^(lanes-1-lane))
+int queue_lanes = 1;
+int weighted_lanes = 0;
+int lane_credit[MAX_LANES] = { 0 };
+
+// broadcast mode: '+' starts a subscriber that sees every message instead of a competing consumer
+int broadcast_mode = 0;
+
+// file backing: a separate process msyncs the ring periodically, enqueue itself never does a syscall for durability
+const char *queue_path = NULL;
+int sync_interval_ms = DEFAULT_SYNC_INTERVAL_MS;
+pid_t syncer_pid = 0;
+
 
 void termination_handler(int signum) 
 {
@@ -63,6 +114,9 @@ void termination_handler(int signum)
 
 void delay(void) 
 {
+    if (bench)
+        return;
+
     struct timespec ts = { 5, 0 };
     nanosleep(&ts, NULL);
 }
@@ -78,36 +132,248 @@ void read_command(char *buffer)
     buffer[strcspn(buffer, "\n")] = '\0';
 }
 
-void init_semaphores(void) 
+// whole-string decimal in min..max, anything else stops the program
+int parse_int_option(const char *text, long min, long max, const char *what)
+{
+    char *end;
+
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || value < min || value > max)
+    {
+        fprintf(stderr, "Invalid %s: %s (%ld..%ld)\n", what, text, min, max);
+        exit(EXIT_FAILURE);
+    }
+    return (int)value;
+}
+
+void parse_args(int argc, char *argv[], int *capacity, queue_backing *backing, int *backing_set) 
 {
-    sem_id = semget(SEM_KEY, 3, IPC_CREAT | 0666);
-    if (sem_id == -1) 
+    int opt;
+
+    *capacity = QUEUE_DEFAULT_SIZE;
+    *backing = QUEUE_BACKING_SHM;
+    *backing_set = 0;
+
+    while ((opt = getopt(argc, argv, "n:b:B:p:c:s:d:l:w:m:f:y:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            *capacity = parse_int_option(optarg, 1, MAX_QUEUE_SIZE, "queue capacity");
+            break;
+        case 'b':
+            if (queue_parse_backing(optarg, backing) != 0)
+            {
+                fprintf(stderr, "Invalid queue backing: %s (shm, memfd, huge or file)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            *backing_set = 1;
+            break;
+        case 'B':
+            bench_seconds = parse_int_option(optarg, 0, INT_MAX, "benchmark seconds");
+            break;
+        case 'p':
+            bench_producers = parse_int_option(optarg, 1, MAX_PROCESSES_COUNT, "producers count");
+            break;
+        case 'c':
+            bench_consumers = parse_int_option(optarg, 1, MAX_PROCESSES_COUNT, "consumers count");
+            break;
+        case 's':
+            queue_shards = parse_int_option(optarg, 1, MAX_SHARDS, "shards count");
+            break;
+        case 'd':
+            if (!strcmp(optarg, "type"))
+                distribute_by_type = 1;
+            else if (!strcmp(optarg, "rr"))
+                distribute_by_type = 0;
+            else
+            {
+                fprintf(stderr, "Invalid distribution: %s (rr or type)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'l':
+            queue_lanes = parse_int_option(optarg, 1, MAX_LANES, "lanes count");
+            break;
+        case 'w':
+            if (!strcmp(optarg, "weighted"))
+                weighted_lanes = 1;
+            else if (!strcmp(optarg, "strict"))
+                weighted_lanes = 0;
+            else
+            {
+                fprintf(stderr, "Invalid lane policy: %s (strict or weighted)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            queue_path = optarg;
+            *backing = QUEUE_BACKING_FILE;
+            *backing_set = 1;
+            break;
+        case 'y':
+            sync_interval_ms = parse_int_option(optarg, 1, INT_MAX, "sync interval");
+            break;
+        case 'm':
+            if (!strcmp(optarg, "broadcast"))
+                broadcast_mode = 1;
+            else if (!strcmp(optarg, "queue"))
+                broadcast_mode = 0;
+            else
+            {
+                fprintf(stderr, "Invalid mode: %s (queue or broadcast)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n capacity] [-b shm|memfd|huge] [-f path [-y sync_ms]] [-s shards] [-d rr|type] [-l lanes] [-w strict|weighted] [-m queue|broadcast] [-B seconds -p producers -c consumers]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (bench_seconds < 0 || bench_producers <= 0 || bench_consumers <= 0
+        || bench_producers + bench_consumers > MAX_PROCESSES_COUNT)
+    {
+        fprintf(stderr, "Invalid benchmark parameters\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (*backing == QUEUE_BACKING_FILE && !queue_path)
+    {
+        fprintf(stderr, "File backing needs a path: -f path\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (broadcast_mode && (queue_shards != 1 || queue_lanes != 1))
     {
-        perror("Semget error");
+        fprintf(stderr, "Broadcast mode uses a single ring, shards and lanes are not supported\n");
         exit(EXIT_FAILURE);
     }
+}
+
+// values come from the ring state, so a recovered queue starts with its pending messages counted
+void init_semaphores(void) 
+{
+    for (int i = 0; i < queue->shard_count; i++)
+    {
+        message_queue *shard = queue_shard(queue, i);
+        int pending = 0;
+
+        for (int j = 0; j < queue->lane_count; j++)
+        {
+            message_queue *ring = queue_lane(shard, j);
+            pending += ring->count;
+            if (sem_init(&ring->sems[EL_COUNT_SEM], 1, 0) == -1
+                || sem_init(&ring->sems[FREE_SPACE_SEM], 1, ring->free_space) == -1
+                || sem_init(&ring->sems[QUEUE_ACCESS_SEM], 1, 1) == -1) 
+            {
+                perror("Sem_init error");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        signal_semaphore_n(shard, EL_COUNT_SEM, pending);
+    }
+}
 
-    semctl(sem_id, EL_COUNT_SEM, SETVAL, 0);
-    semctl(sem_id, FREE_SPACE_SEM, SETVAL, QUEUE_SIZE);
-    semctl(sem_id, QUEUE_ACCESS_SEM, SETVAL, 1);
+void destroy_semaphores(void) 
+{
+    for (int i = 0; i < queue->shard_count * queue->lane_count; i++)
+    {
+        message_queue *ring = queue_lane(queue, i);
+        for (int j = 0; j < QUEUE_SEMS_COUNT; j++)
+        {
+            sem_destroy(&ring->sems[j]);
+        }
+    }
 }
 
-void wait_semaphore(int sem_num) 
+int wait_semaphore(message_queue *q, int sem_num) 
 {
-    struct sembuf sb;
-    sb.sem_num = sem_num;
-    sb.sem_op = -1;
-    sb.sem_flg = 0;
-    semop(sem_id, &sb, 1);
+    int res;
+    // the access semaphore is a lock, it must not be skipped when SIGUSR1 interrupts the wait
+    while ((res = sem_wait(&q->sems[sem_num])) == -1 && errno == EINTR && sem_num == QUEUE_ACCESS_SEM);
+    return res;
 }
 
-void signal_semaphore(int sem_num) 
+int timed_wait_semaphore(message_queue *q, int sem_num, long timeout_ns) 
 {
-    struct sembuf sb;
-    sb.sem_num = sem_num;
-    sb.sem_op = 1;
-    sb.sem_flg = 0;
-    semop(sem_id, &sb, 1);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += timeout_ns;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    return sem_timedwait(&q->sems[sem_num], &ts);
+}
+
+int try_wait_semaphore(message_queue *q, int sem_num) 
+{
+    return sem_trywait(&q->sems[sem_num]) == 0;
+}
+
+void signal_semaphore(message_queue *q, int sem_num) 
+{
+    signal_semaphore_n(q, sem_num, 1);
+}
+
+void signal_semaphore_n(message_queue *q, int sem_num, int n) 
+{
+    for (int i = 0; i < n; i++)
+    {
+        sem_post(&q->sems[sem_num]);
+    }
+}
+
+// returns the lane ring with one free slot already reserved, NULL when interrupted
+message_queue* reserve_ring(const message *msg)
+{
+    int lane = queue_lane_for_type(queue, msg->type);
+
+    if (distribute_by_type)
+    {
+        message_queue *ring = queue_lane(queue_shard(queue, msg->type % queue->shard_count), lane);
+        return (wait_semaphore(ring, FREE_SPACE_SEM) == -1) ? NULL : ring;
+    }
+
+    // round robin, skipping shards whose lane is full right now
+    int start = next_shard;
+    next_shard = (next_shard + 1) % queue->shard_count;
+    for (int i = 0; i < queue->shard_count; i++)
+    {
+        message_queue *ring = queue_lane(queue_shard(queue, (start + i) % queue->shard_count), lane);
+        if (try_wait_semaphore(ring, FREE_SPACE_SEM))
+            return ring;
+    }
+
+    message_queue *ring = queue_lane(queue_shard(queue, start), lane);
+    return (wait_semaphore(ring, FREE_SPACE_SEM) == -1) ? NULL : ring;
+}
+
+void backoff(int *spins)
+{
+    struct timespec ts = { 0, BACKOFF_SLEEP_NS };
+
+    if (++(*spins) < BACKOFF_SPINS)
+        return;
+    if (*spins < BACKOFF_YIELDS)
+        sched_yield();
+    else
+        nanosleep(&ts, NULL);
+}
+
+// waits until the slowest subscriber is less than a full ring behind `seq`
+int wait_gating(uint64_t seq)
+{
+    int spins = 0;
+
+    while (seq - broadcast_min_cursor(queue) >= (uint64_t)queue->capacity)
+    {
+        if (terminate_flag)
+            return -1;
+        backoff(&spins);
+    }
+    return 0;
 }
 
 void producer_process(void)
@@ -115,18 +381,53 @@ void producer_process(void)
     signal(SIGUSR1, termination_handler);
     message msg;
 
+    next_shard = process_ordinal % queue->shard_count;
+    message_rng_seed(((uint64_t)getpid() << 32) ^ bench_now_ns());
+    generate_message(&msg);
+
     while (!terminate_flag)
     {
-        wait_semaphore(FREE_SPACE_SEM);
-        wait_semaphore(QUEUE_ACCESS_SEM);
+        if (broadcast_mode)
+        {
+            // producers are sequenced by the access semaphore, subscribers never take it
+            wait_semaphore(queue, QUEUE_ACCESS_SEM);
+            if (wait_gating(atomic_load(&queue->published)) == -1)
+            {
+                signal_semaphore(queue, QUEUE_ACCESS_SEM);
+                continue;
+            }
 
-        generate_message(&msg);
-        enqueue(queue, &msg);
+            msg.send_time = bench_now_ns();
+            broadcast_publish(queue, &msg);
+            signal_semaphore(queue, QUEUE_ACCESS_SEM);
+
+            if (bench)
+                bench_slot->sent++;
+            else
+                printf("Producer: Message published, count = %d\n", queue->added_count);
+
+            generate_message(&msg);
+            delay();
+            continue;
+        }
+
+        message_queue *ring = reserve_ring(&msg);
+        if (!ring)
+            continue;
+        wait_semaphore(ring, QUEUE_ACCESS_SEM);
 
-        signal_semaphore(QUEUE_ACCESS_SEM);
-        signal_semaphore(EL_COUNT_SEM);
+        msg.send_time = bench_now_ns();
+        enqueue(ring, &msg);
 
-        printf("Producer: Message added, count = %d\n", queue->added_count);
+        signal_semaphore(ring, QUEUE_ACCESS_SEM);
+        signal_semaphore(queue_shard(queue, ring->shard_index), EL_COUNT_SEM);
+
+        if (bench)
+            bench_slot->sent++;
+        else
+            printf("Producer: Message added to shard %d lane %d, count = %d\n", ring->shard_index, ring->lane_index, ring->added_count);
+
+        generate_message(&msg);
         delay();
     }
 
@@ -134,38 +435,231 @@ void producer_process(void)
     exit(EXIT_SUCCESS);
 }
 
+void lane_order(message_queue *shard, int *order)
+{
+    int lanes = shard->lane_count;
+    int best = -1;
+    int total = 0;
+
+    for (int i = 0; i < lanes; i++)
+        order[i] = i;
+
+    if (!weighted_lanes || lanes == 1)
+        return;
+
+    // smooth weighted round robin over the lanes that have messages, the rest keep strict order
+    for (int i = 0; i < lanes; i++)
+    {
+        if (queue_lane(shard, i)->count == 0)
+            continue;
+
+        int weight = 1 << (lanes - 1 - i);
+        lane_credit[i] += weight;
+        total += weight;
+        if (best == -1 || lane_credit[i] > lane_credit[best])
+            best = i;
+    }
+
+    if (best == -1)
+        return;
+
+    lane_credit[best] -= total;
+    for (int i = best; i > 0; i--)
+        order[i] = order[i - 1];
+    order[0] = best;
+}
+
+void check_message(const message *msg, message_queue *q)
+{
+    uint32_t hash = calculate_hash(msg);
+    if (bench)
+    {
+        bench_record(bench_slot, msg, bench_now_ns(), q->lane_index);
+        if (hash != msg->hash)
+            bench_slot->invalid++;
+    }
+    else if (hash == msg->hash) 
+    {
+        printf("Consumer: Message consumed from shard %d lane %d, count = %d\n", q->shard_index, q->lane_index, q->removed_count);
+    } 
+    else 
+    {
+        printf("Consumer: Invalid hash!\n");
+    }
+}
+
+// called with one element of the shard already reserved
+void consume_own_shard(message_queue *shard)
+{
+    queue_lease lease;
+    message_queue *ring = NULL;
+    int order[MAX_LANES];
+    int leased = 0;
+
+    int reserved = 1;
+    while (reserved < CONSUME_BATCH_SIZE && try_wait_semaphore(shard, EL_COUNT_SEM))
+        reserved++;
+
+    // the reservation guarantees a message in some lane, it may move while we look
+    while (leased == 0)
+    {
+        lane_order(shard, order);
+        for (int i = 0; i < shard->lane_count && leased == 0; i++)
+        {
+            ring = queue_lane(shard, order[i]);
+            wait_semaphore(ring, QUEUE_ACCESS_SEM);
+            leased = dequeue_lease(ring, reserved, &lease);
+            signal_semaphore(ring, QUEUE_ACCESS_SEM);
+        }
+    }
+
+    // lease stops at the end of the buffer or the lane, give back what did not fit
+    signal_semaphore_n(shard, EL_COUNT_SEM, reserved - leased);
+
+    // leased slots are not counted as free space, producers cannot overwrite them
+    for (int i = 0; i < lease.count; i++)
+    {
+        check_message(&lease.messages[i], ring);
+    }
+
+    wait_semaphore(ring, QUEUE_ACCESS_SEM);
+    int freed = dequeue_release(ring, &lease);
+    signal_semaphore(ring, QUEUE_ACCESS_SEM);
+
+    signal_semaphore_n(ring, FREE_SPACE_SEM, freed);
+}
+
+// take the newest messages of another shard, the owner keeps draining from the head
+int steal_work(message_queue *own)
+{
+    message stolen[CONSUME_BATCH_SIZE];
+    message_queue *ring = NULL;
+    int order[MAX_LANES];
+
+    for (int i = 1; i < queue->shard_count; i++)
+    {
+        message_queue *victim = queue_shard(queue, (own->shard_index + i) % queue->shard_count);
+        if (!try_wait_semaphore(victim, EL_COUNT_SEM))
+            continue;
+
+        int reserved = 1;
+        while (reserved < CONSUME_BATCH_SIZE / 2 && try_wait_semaphore(victim, EL_COUNT_SEM))
+            reserved++;
+
+        int count = 0;
+        while (count == 0)
+        {
+            lane_order(victim, order);
+            for (int j = 0; j < victim->lane_count && count == 0; j++)
+            {
+                ring = queue_lane(victim, order[j]);
+                wait_semaphore(ring, QUEUE_ACCESS_SEM);
+                count = steal_tail(ring, reserved, stolen);
+                signal_semaphore(ring, QUEUE_ACCESS_SEM);
+            }
+        }
+
+        signal_semaphore_n(ring, FREE_SPACE_SEM, count);
+        signal_semaphore_n(victim, EL_COUNT_SEM, reserved - count);
+
+        for (int j = 0; j < count; j++)
+        {
+            check_message(&stolen[j], ring);
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
 void consumer_process(void) 
 {
     signal(SIGUSR1, termination_handler);
-    message* msg;
+    message_queue *own = queue_shard(queue, process_ordinal % queue->shard_count);
 
     while (!terminate_flag) 
     {
-        wait_semaphore(EL_COUNT_SEM);  
-        wait_semaphore(QUEUE_ACCESS_SEM);  
+        if (queue->shard_count == 1)
+        {
+            if (wait_semaphore(own, EL_COUNT_SEM) == -1)
+                continue;
+        }
+        else if (!try_wait_semaphore(own, EL_COUNT_SEM))
+        {
+            // own shard is empty: help the others, otherwise park briefly on our own shard
+            if (steal_work(own))
+            {
+                delay();
+                continue;
+            }
+            if (timed_wait_semaphore(own, EL_COUNT_SEM, STEAL_POLL_NS) == -1)
+                continue;
+        }
 
-        msg = dequeue(queue);
+        consume_own_shard(own);
+        delay();
+    }
 
-        signal_semaphore(QUEUE_ACCESS_SEM);
-        signal_semaphore(FREE_SPACE_SEM);
+    printf("Consumer: Terminating\n");
+    exit(EXIT_SUCCESS);
+}
 
-        if (msg) 
+void subscriber_process(void)
+{
+    signal(SIGUSR1, termination_handler);
+    uint64_t consumed = 0;
+    int spins = 0;
+
+    wait_semaphore(queue, QUEUE_ACCESS_SEM);
+    int slot = broadcast_subscribe(queue);
+    signal_semaphore(queue, QUEUE_ACCESS_SEM);
+
+    if (slot == -1)
+    {
+        printf("Subscriber: no free cursor, at most %d subscribers\n", MAX_SUBSCRIBERS);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t next = atomic_load(&queue->cursors[slot]);
+    while (!terminate_flag)
+    {
+        uint64_t available = atomic_load_explicit(&queue->published, memory_order_acquire);
+        if (next == available)
         {
-            uint16_t hash = calculate_hash(msg);
-            if (hash == msg->hash) 
+            backoff(&spins);
+            continue;
+        }
+        spins = 0;
+
+        // read in place: the producer cannot wrap over a slot until our cursor has passed it
+        for (; next < available; next++)
+        {
+            const message *msg = broadcast_peek(queue, next);
+            uint32_t hash = calculate_hash(msg);
+            consumed++;
+
+            if (bench)
+            {
+                bench_record(bench_slot, msg, bench_now_ns(), 0);
+                if (hash != msg->hash)
+                    bench_slot->invalid++;
+            }
+            else if (hash == msg->hash)
             {
-                printf("Consumer: Message consumed, count = %d\n", queue->removed_count);
-            } 
-            else 
+                printf("Subscriber %d: Message %" PRIu64 " received, count = %" PRIu64 "\n", slot, next, consumed);
+            }
+            else
             {
-                printf("Consumer: Invalid hash!\n");
+                printf("Subscriber %d: Invalid hash!\n", slot);
             }
         }
 
+        atomic_store_explicit(&queue->cursors[slot], next, memory_order_release);
         delay();
     }
 
-    printf("Consumer: Terminating\n");
+    broadcast_unsubscribe(queue, slot);
+    printf("Subscriber: Terminating\n");
     exit(EXIT_SUCCESS);
 }
 
@@ -177,10 +671,23 @@ void create_process(const char process_type)
         return;
     }
 
+    if (bench)
+        bench_slot = &bench->slots[processes_count];
+
+    process_ordinal = 0;
+    for (int i = 0; i < processes_count; i++)
+    {
+        if (processes_types[i] == ((process_type == '+') ? CONSUMER_PROCESS : PRODUCER_PROCESS))
+            process_ordinal++;
+    }
+
+    fflush(stdout);
     pid_t pid = fork();
     if (pid == 0) 
     {
-        if (process_type == '+')
+        if (process_type == '+' && broadcast_mode)
+            subscriber_process();
+        else if (process_type == '+')
             consumer_process();
         else if (process_type == '*')
             producer_process();
@@ -235,6 +742,42 @@ void kill_process(int index)
     processes_count--;
 }
 
+void start_syncer(void)
+{
+    if (queue->backing != QUEUE_BACKING_FILE)
+        return;
+
+    fflush(stdout);
+    syncer_pid = fork();
+    if (syncer_pid == 0)
+    {
+        struct timespec ts = { sync_interval_ms / 1000, (sync_interval_ms % 1000) * 1000000L };
+        signal(SIGUSR1, termination_handler);
+
+        while (!terminate_flag)
+        {
+            nanosleep(&ts, NULL);
+            queue_sync(queue);
+        }
+        exit(EXIT_SUCCESS);
+    }
+    else if (syncer_pid == -1)
+    {
+        perror("Fork error");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void stop_syncer(void)
+{
+    if (syncer_pid <= 0)
+        return;
+
+    kill(syncer_pid, SIGUSR1);
+    waitpid(syncer_pid, NULL, 0);
+    syncer_pid = 0;
+}
+
 void cleanup_and_exit(void) 
 {
     printf("Shutting down...\n");
@@ -248,23 +791,93 @@ void cleanup_and_exit(void)
         }
     }
 
+    stop_syncer();
     while (wait(NULL) > 0);
 
-    if (!queue) 
-        queue_destroy(shm_id, queue);
-    semctl(sem_id, 0, IPC_RMID);
+    if (queue) 
+    {
+        destroy_semaphores();
+        queue_destroy(queue);
+    }
 
     printf("Cleanup complete. Exiting...\n");
     exit(EXIT_SUCCESS);
 }
 
-int main() 
+void run_benchmark(int capacity, queue_backing backing)
+{
+    struct timespec duration = { bench_seconds, 0 };
+    char label[128];
+
+    // leftovers from an earlier run would distort the latency numbers
+    if (backing == QUEUE_BACKING_FILE)
+        queue_file_discard(queue_path);
+
+    queue = queue_init(capacity, backing, queue_shards, queue_lanes, queue_path);
+    init_semaphores();
+    start_syncer();
+    bench = bench_create();
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < bench_producers; i++)
+        create_process('*');
+    for (int i = 0; i < bench_consumers; i++)
+        create_process('+');
+
+    nanosleep(&duration, NULL);
+
+    for (int i = 0; i < processes_count; i++)
+        kill(processes[i], SIGUSR1);
+    uint64_t elapsed = bench_now_ns() - start;
+    stop_syncer();
+
+    // wake everyone still blocked so they can see the termination flag
+    for (int i = 0; i < queue->shard_count * queue->lane_count; i++)
+        signal_semaphore_n(queue_lane(queue, i), FREE_SPACE_SEM, bench_producers);
+    for (int i = 0; i < queue->shard_count; i++)
+        signal_semaphore_n(queue_shard(queue, i), EL_COUNT_SEM, bench_consumers);
+    while (wait(NULL) > 0);
+    processes_count = 0;
+
+    if (broadcast_mode)
+        snprintf(label, sizeof(label), "%s, broadcast", queue_backing_name(backing));
+    else
+        snprintf(label, sizeof(label), "%s, %d shard(s), %s, %d %s lane(s)", queue_backing_name(backing), queue_shards,
+            distribute_by_type ? "by type" : "round robin", queue_lanes, weighted_lanes ? "weighted" : "strict");
+    bench_report(bench, label, bench_producers, bench_consumers, queue_lanes, elapsed / 1e9);
+
+    bench_destroy(bench);
+    bench = NULL;
+    destroy_semaphores();
+    queue_destroy(queue);
+    queue = NULL;
+}
+
+int main(int argc, char *argv[]) 
 {
     char command[MAX_COMMAND_LEN] = { 0 };
-    srand(time(NULL));
+    int capacity = 0;
+    int backing_set = 0;
+    queue_backing backing = QUEUE_BACKING_SHM;
+
+    parse_args(argc, argv, &capacity, &backing, &backing_set);
+
+    if (bench_seconds > 0)
+    {
+        // without an explicit backing compare all of them
+        for (int b = QUEUE_BACKING_SHM; b <= QUEUE_BACKING_FILE; b++)
+        {
+            if ((!backing_set && b != QUEUE_BACKING_FILE) || (queue_backing)b == backing)
+                run_benchmark(capacity, (queue_backing)b);
+        }
+        return 0;
+    }
 
-    queue = queue_init(&shm_id);
+    queue = queue_init(capacity, backing, queue_shards, queue_lanes, queue_path);
+    queue_shards = queue->shard_count;
+    queue_lanes = queue->lane_count;
     init_semaphores();
+    start_syncer();
 
     printf("+: Create consumer\n*: Create producer\nl: Print all processes\ni: Print queue info\nk<n>: kill n process\nq: exit programm\n");
     while (1)
@@ -3,22 +3,150 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 
-uint16_t calculate_hash(const message *msg) 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#define CRC32C_POLY 0x82F63B78u
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t *buf, size_t len);
+
+static uint32_t crc32c_table[256];
+static crc32c_fn crc32c_impl = NULL;
+
+// xoshiro256** state, private to each process after fork
+static uint64_t rng_state[4] = { 0x9E3779B97F4A7C15ull, 0xBF58476D1CE4E5B9ull, 0x94D049BB133111EBull, 0x2545F4914F6CDD1Dull };
+
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = crc32c_table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    uint64_t crc64 = crc;
+    while (len >= sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, buf, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        buf += sizeof(word);
+        len -= sizeof(word);
+    }
+
+    crc = (uint32_t)crc64;
+    while (len-- > 0)
+    {
+        crc = _mm_crc32_u8(crc, *buf++);
+    }
+    return crc;
+}
+#elif defined(__aarch64__)
+__attribute__((target("+crc")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    while (len >= sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, buf, sizeof(word));
+        crc = __crc32cd(crc, word);
+        buf += sizeof(word);
+        len -= sizeof(word);
+    }
+
+    while (len-- > 0)
+    {
+        crc = __crc32cb(crc, *buf++);
+    }
+    return crc;
+}
+#endif
+
+static void crc32c_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[i] = crc;
+    }
+
+    crc32c_impl = crc32c_scalar;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+        crc32c_impl = crc32c_hw;
+#elif defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+        crc32c_impl = crc32c_hw;
+#endif
+}
+
+uint32_t calculate_hash(const message *msg) 
+{
+    if (!crc32c_impl)
+        crc32c_init();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    crc = crc32c_impl(crc, &msg->type, 1);
+    crc = crc32c_impl(crc, &msg->size, 1);
+    crc = crc32c_impl(crc, msg->data, msg->size);
+    return ~crc;
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t rng_next(void)
+{
+    uint64_t *st = rng_state;
+    uint64_t result = rotl(st[1] * 5, 7) * 9;
+    uint64_t t = st[1] << 17;
+
+    st[2] ^= st[0];
+    st[3] ^= st[1];
+    st[1] ^= st[2];
+    st[0] ^= st[3];
+    st[2] ^= t;
+    st[3] = rotl(st[3], 45);
+
+    return result;
+}
+
+void message_rng_seed(uint64_t seed)
 {
-    uint16_t hash = 0;
-    hash += msg->type;
-    for (int i = 0; i < msg->size; i++) 
+    // splitmix64 spreads any seed, even a small pid, over the whole state
+    for (int i = 0; i < 4; i++)
     {
-        hash += msg->data[i];
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        rng_state[i] = z ^ (z >> 31);
     }
-    return hash;
 }
 
 void generate_message(message *msg) 
 {
-    msg->type = rand() % 256;           
-    msg->size = rand() % 256;  
+    uint64_t header = rng_next();
+    msg->type = (uint8_t)header;
+    msg->size = (uint8_t)(header >> 8);
 
     if (msg->size == 0) 
     {
@@ -26,9 +154,11 @@ void generate_message(message *msg)
     } 
     else 
     {
-        for (int i = 0; i < msg->size; i++)
+        // whole 8-byte words, MAX_DATA_SIZE is a multiple of 8 so the tail stays inside data
+        for (int i = 0; i < msg->size; i += sizeof(uint64_t))
         {
-            msg->data[i] = rand() % 256;
+            uint64_t word = rng_next();
+            memcpy(&msg->data[i], &word, sizeof(word));
         }
     }
 
@@ -8,13 +8,17 @@
 typedef struct 
 {
     uint8_t type;            
-    uint16_t hash;           
     uint8_t size;            
+    uint32_t hash;           
+    uint64_t send_time;
     uint8_t data[MAX_DATA_SIZE];
 } message;
 
+void message_rng_seed(uint64_t seed);
+
 void generate_message(message *msg);
 
-uint16_t calculate_hash(const message *msg);
+// CRC32C of type, size and data, SSE4.2/ARMv8 CRC instructions when the CPU has them
+uint32_t calculate_hash(const message *msg);
 
 #endif
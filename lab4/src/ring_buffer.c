@@ -1,46 +1,276 @@
+#define _GNU_SOURCE
 #include "ring_buffer.h"
 
 #include <stdio.h>    
 #include <stdlib.h>   
 #include <string.h>
-#include <sys/shm.h>
-#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 
+static const char *backing_names[] = { "shm", "memfd", "huge", "file" };
 
-message_queue* queue_init(int *shm_id) 
+
+int queue_parse_backing(const char *name, queue_backing *backing)
+{
+    for (int i = 0; i < (int)(sizeof(backing_names) / sizeof(backing_names[0])); i++)
+    {
+        if (!strcmp(name, backing_names[i]))
+        {
+            *backing = (queue_backing)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* queue_backing_name(queue_backing backing)
+{
+    return backing_names[backing];
+}
+
+static void* map_fd(int fd, size_t size)
+{
+    if (ftruncate(fd, size) == -1) 
+    {
+        perror("Ftruncate error");
+        exit(EXIT_FAILURE);
+    }
+
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return addr;
+}
+
+// an existing queue file dictates the geometry, returns 1 when there is something to recover
+static int read_file_layout(int fd, const char *path, int *capacity, int *shards, int *lanes)
+{
+    struct stat st;
+    message_queue header;
+
+    if (fstat(fd, &st) == -1) 
+    {
+        perror("Fstat queue file error");
+        exit(EXIT_FAILURE);
+    }
+    if (st.st_size == 0)
+        return 0;
+
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+        || header.magic != QUEUE_MAGIC || header.version != QUEUE_LAYOUT_VERSION
+        || header.segment_size != (size_t)st.st_size) 
+    {
+        fprintf(stderr, "%s is not a queue file of layout version %d\n", path, QUEUE_LAYOUT_VERSION);
+        exit(EXIT_FAILURE);
+    }
+
+    *capacity = header.capacity;
+    *shards = header.shard_count;
+    *lanes = header.lane_count;
+    return 1;
+}
+
+// empties a queue file left by an earlier run, anything that is not a queue of this layout stops the program untouched
+void queue_file_discard(const char *path)
 {
-    *shm_id = shmget(SHM_KEY, sizeof(message_queue), IPC_CREAT | 0666);
-    if (*shm_id == -1) 
+    int capacity, shards, lanes;
+    int fd = open(path, O_RDWR);
+    if (fd == -1)
+    {
+        if (errno == ENOENT)
+            return;
+        perror("Open queue file error");
+        exit(EXIT_FAILURE);
+    }
+
+    if (read_file_layout(fd, path, &capacity, &shards, &lanes) && ftruncate(fd, 0) == -1)
     {
-        perror("Shmget error");
+        perror("Ftruncate error");
         exit(EXIT_FAILURE);
     }
+    close(fd);
+}
+
+// messages that were leased but not released when the writer died are handed out again
+static void recover_ring(message_queue *q)
+{
+    q->slot_leased = (uint8_t*) &q->buffer[q->capacity];
+    if (q->leased > 0)
+    {
+        q->head = q->release_head;
+        q->count += q->leased;
+        q->removed_count -= q->leased;
+        q->leased = 0;
+    }
+    q->release_head = q->head;
+    q->free_space = q->capacity - q->count;
+    memset(q->slot_leased, 0, q->capacity);
+
+    for (int j = 0; j < MAX_SUBSCRIBERS; j++)
+    {
+        atomic_store(&q->cursors[j], CURSOR_FREE);
+    }
+}
+
+message_queue* queue_init(int capacity, queue_backing backing, int shards, int lanes, const char *path) 
+{
+    int file_fd = -1;
+    int recovered = 0;
+
+    if (backing == QUEUE_BACKING_FILE)
+    {
+        file_fd = open(path, O_RDWR | O_CREAT, 0666);
+        if (file_fd == -1) 
+        {
+            perror("Open queue file error");
+            exit(EXIT_FAILURE);
+        }
+        recovered = read_file_layout(file_fd, path, &capacity, &shards, &lanes);
+    }
+
+    size_t page_size = (backing == QUEUE_BACKING_HUGE) ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    size_t stride = sizeof(message_queue) + (size_t)capacity * (sizeof(message) + sizeof(uint8_t));
+    stride = (stride + SHARD_ALIGN - 1) / SHARD_ALIGN * SHARD_ALIGN;
+    size_t size = stride * shards * lanes;
+    size = (size + page_size - 1) / page_size * page_size;
+
+    void *addr = MAP_FAILED;
+    if (backing == QUEUE_BACKING_SHM)
+    {
+        int fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
+        if (fd == -1) 
+        {
+            perror("Shm_open error");
+            exit(EXIT_FAILURE);
+        }
+        addr = map_fd(fd, size);
+    }
+    else if (backing == QUEUE_BACKING_MEMFD)
+    {
+        int fd = memfd_create("lab4_message_queue", MFD_CLOEXEC);
+        if (fd == -1) 
+        {
+            perror("Memfd_create error");
+            exit(EXIT_FAILURE);
+        }
+        addr = map_fd(fd, size);
+    }
+    else if (backing == QUEUE_BACKING_HUGE)
+    {
+        // children are forked, so an anonymous shared mapping is visible to all of them
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr == MAP_FAILED) 
+        {
+            perror("Huge pages unavailable, falling back to regular pages");
+            addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (addr != MAP_FAILED)
+                madvise(addr, size, MADV_HUGEPAGE);
+        }
+    }
+    else if (backing == QUEUE_BACKING_FILE)
+    {
+        addr = map_fd(file_fd, size);
+    }
 
-    message_queue *q = (message_queue*) shmat(*shm_id, NULL, 0);
-    if (q == (void*) -1) 
+    if (addr == MAP_FAILED) 
     {
-        perror("Shmat error");
+        perror("Mmap error");
         exit(EXIT_FAILURE);
     }
 
-    q->head = 0;
-    q->tail = 0;
-    q->count = 0;
-    q->added_count = 0;
-    q->removed_count = 0;
-    q->free_space = QUEUE_SIZE;
-    memset(q->buffer, 0, sizeof(q->buffer));
+    if (recovered)
+    {
+        message_queue *first = (message_queue*) addr;
+        int pending = 0;
+        for (int i = 0; i < shards * lanes; i++)
+        {
+            message_queue *q = (message_queue*) ((char*) addr + i * stride);
+            recover_ring(q);
+            pending += q->count;
+        }
+
+        printf("Recovered %s after %s shutdown: %d pending message(s)\n", path, first->clean_shutdown ? "clean" : "unclean", pending);
+        first->clean_shutdown = 0;
+        return first;
+    }
 
-    return q;
+    // every lane of every shard is a complete ring with its own header, laid out back to back
+    for (int i = 0; i < shards * lanes; i++)
+    {
+        message_queue *q = (message_queue*) ((char*) addr + i * stride);
+        memset(q, 0, sizeof(message_queue));
+
+        q->magic = QUEUE_MAGIC;
+        q->version = QUEUE_LAYOUT_VERSION;
+        q->backing = backing;
+        q->segment_size = size;
+        q->ring_stride = stride;
+        q->shard_count = shards;
+        q->shard_index = i / lanes;
+        q->lane_count = lanes;
+        q->lane_index = i % lanes;
+        q->capacity = capacity;
+        q->head = 0;
+        q->tail = 0;
+        q->count = 0;
+        q->added_count = 0;
+        q->removed_count = 0;
+        q->free_space = capacity;
+        q->leased = 0;
+        q->release_head = 0;
+        // the segment is mapped before fork, so this address is the same in every child
+        q->slot_leased = (uint8_t*) &q->buffer[capacity];
+        memset(q->slot_leased, 0, capacity);
+
+        atomic_init(&q->published, 0);
+        for (int j = 0; j < MAX_SUBSCRIBERS; j++)
+        {
+            atomic_init(&q->cursors[j], CURSOR_FREE);
+        }
+    }
+
+    return (message_queue*) addr;
 }
 
-void queue_destroy(int shm_id, message_queue *q) 
+message_queue* queue_shard(message_queue *q, int index)
 {
-    shmdt(q);
-    shmctl(shm_id, IPC_RMID, NULL);
+    return (message_queue*) ((char*) q + (size_t)index * q->lane_count * q->ring_stride);
+}
+
+message_queue* queue_lane(message_queue *shard, int lane)
+{
+    return (message_queue*) ((char*) shard + (size_t)lane * shard->ring_stride);
+}
+
+int queue_lane_for_type(message_queue *q, uint8_t type)
+{
+    return type * q->lane_count / 256;
+}
+
+void queue_sync(message_queue *q) 
+{
+    if (msync(q, q->segment_size, MS_SYNC) == -1)
+        perror("Msync error");
+}
+
+void queue_destroy(message_queue *q) 
+{
+    queue_backing backing = q->backing;
+
+    // a file-backed queue outlives the process, its contents are kept for the next start
+    if (backing == QUEUE_BACKING_FILE)
+    {
+        q->clean_shutdown = 1;
+        queue_sync(q);
+    }
+
+    munmap(q, q->segment_size);
+    if (backing == QUEUE_BACKING_SHM)
+        shm_unlink(SHM_NAME);
 }
 
 void enqueue(message_queue *q, message *msg)
@@ -52,30 +282,162 @@ void enqueue(message_queue *q, message *msg)
     }
 
     q->buffer[q->tail] = *msg;
-    q->tail = (q->tail + 1) % QUEUE_SIZE;
+    q->tail = (q->tail + 1) % q->capacity;
     q->count++;
     q->added_count++;
     q->free_space--;
 }
 
-message* dequeue(message_queue *q)
+int dequeue_lease(message_queue *q, int max_count, queue_lease *lease)
+{
+    lease->messages = NULL;
+    lease->start = q->head;
+    lease->count = 0;
+
+    if (q->count == 0 || max_count <= 0) 
+        return 0;
+
+    int count = q->count;
+    if (count > max_count)
+        count = max_count;
+    if (count > q->capacity - q->head)
+        count = q->capacity - q->head;
+
+    for (int i = 0; i < count; i++)
+    {
+        q->slot_leased[q->head + i] = 1;
+    }
+
+    lease->messages = &q->buffer[q->head];
+    lease->count = count;
+
+    q->head = (q->head + count) % q->capacity;
+    q->count -= count;
+    q->removed_count += count;
+    q->leased += count;
+
+    return count;
+}
+
+int steal_tail(message_queue *q, int max_count, message *out)
 {
-    if (q->count == 0) 
+    int count = (q->count < max_count) ? q->count : max_count;
+
+    for (int i = 0; i < count; i++)
     {
-        printf("Queue is empty!\n");
-        return NULL;
+        q->tail = (q->tail + q->capacity - 1) % q->capacity;
+        out[i] = q->buffer[q->tail];
     }
 
-    message *msg = &q->buffer[q->head];
-    q->head = (q->head + 1) % QUEUE_SIZE;
-    q->count--;
-    q->removed_count++;
-    q->free_space++;
+    q->count -= count;
+    q->removed_count += count;
+    q->free_space += count;
 
-    return msg;
+    return count;
+}
+
+int dequeue_release(message_queue *q, queue_lease *lease)
+{
+    int freed = 0;
+
+    for (int i = 0; i < lease->count; i++)
+    {
+        q->slot_leased[(lease->start + i) % q->capacity] = 0;
+    }
+
+    while (q->leased > 0 && !q->slot_leased[q->release_head])
+    {
+        q->release_head = (q->release_head + 1) % q->capacity;
+        q->leased--;
+        freed++;
+    }
+
+    q->free_space += freed;
+    lease->messages = NULL;
+    lease->count = 0;
+
+    return freed;
+}
+
+// the callers hold the access semaphore, so producers never miss a new cursor while gating
+int broadcast_subscribe(message_queue *q)
+{
+    for (int i = 0; i < MAX_SUBSCRIBERS; i++)
+    {
+        if (atomic_load(&q->cursors[i]) == CURSOR_FREE)
+        {
+            atomic_store(&q->cursors[i], atomic_load(&q->published));
+            return i;
+        }
+    }
+    return -1;
+}
+
+void broadcast_unsubscribe(message_queue *q, int slot)
+{
+    atomic_store_explicit(&q->cursors[slot], CURSOR_FREE, memory_order_release);
+}
+
+// slowest subscriber, the producer must not get a full ring ahead of it
+uint64_t broadcast_min_cursor(message_queue *q)
+{
+    uint64_t min = atomic_load_explicit(&q->published, memory_order_relaxed);
+
+    for (int i = 0; i < MAX_SUBSCRIBERS; i++)
+    {
+        uint64_t cursor = atomic_load_explicit(&q->cursors[i], memory_order_acquire);
+        if (cursor < min)
+            min = cursor;
+    }
+    return min;
+}
+
+void broadcast_publish(message_queue *q, const message *msg)
+{
+    uint64_t seq = atomic_load_explicit(&q->published, memory_order_relaxed);
+
+    q->buffer[seq % q->capacity] = *msg;
+    q->added_count++;
+    atomic_store_explicit(&q->published, seq + 1, memory_order_release);
+}
+
+const message* broadcast_peek(message_queue *q, uint64_t seq)
+{
+    return &q->buffer[seq % q->capacity];
 }
 
 void print_queue_info(message_queue *q)
 {
-    printf("\nMessages count: %d, Free space: %d, Messages sent: %d, Messages receaved %d\n\n", q->count, q->free_space, q->added_count, q->removed_count);
-}
\ No newline at end of file
+    int lane_depth[MAX_LANES] = { 0 };
+
+    printf("\nLayout version: %u, Shards: %d, Lanes: %d, Capacity per lane: %d, Backing: %s, Segment size: %zu\n", q->version, q->shard_count, q->lane_count, q->capacity, queue_backing_name(q->backing), q->segment_size);
+    for (int i = 0; i < q->shard_count; i++)
+    {
+        for (int j = 0; j < q->lane_count; j++)
+        {
+            message_queue *ring = queue_lane(queue_shard(q, i), j);
+            lane_depth[j] += ring->count;
+            printf("Shard %d lane %d: Messages count: %d, Free space: %d, Leased: %d, Messages sent: %d, Messages receaved %d\n", i, j, ring->count, ring->free_space, ring->leased, ring->added_count, ring->removed_count);
+        }
+    }
+
+    printf("Lane depth:");
+    for (int j = 0; j < q->lane_count; j++)
+    {
+        printf(" [%d] %d", j, lane_depth[j]);
+    }
+    printf("\n");
+
+    uint64_t published = atomic_load(&q->published);
+    if (published > 0)
+    {
+        printf("Broadcast published: %" PRIu64 "\n", published);
+        for (int i = 0; i < MAX_SUBSCRIBERS; i++)
+        {
+            uint64_t cursor = atomic_load(&q->cursors[i]);
+            if (cursor != CURSOR_FREE)
+                printf("Subscriber %d: cursor %" PRIu64 ", lag %" PRIu64 "\n", i, cursor, published - cursor);
+        }
+    }
+    printf("\n");
+}
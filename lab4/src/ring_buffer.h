@@ -1,29 +1,105 @@
 #ifndef RING_BUFFER_H
 #define RING_BUFFER_H
 
+#include <stddef.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
 #include "message.h"
 
-#define QUEUE_SIZE 10  
-#define SHM_KEY 0x1234
+#define QUEUE_MAGIC 0x4E52344Cu
+#define QUEUE_LAYOUT_VERSION 5
+#define QUEUE_DEFAULT_SIZE 10  
+#define QUEUE_SEMS_COUNT 3
+#define SHM_NAME "/lab4_message_queue"
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define SHARD_ALIGN 64
+#define MAX_LANES 4
+#define MAX_SUBSCRIBERS 16
+#define CURSOR_FREE UINT64_MAX
+
+typedef enum
+{
+    QUEUE_BACKING_SHM,
+    QUEUE_BACKING_MEMFD,
+    QUEUE_BACKING_HUGE,
+    QUEUE_BACKING_FILE
+} queue_backing;
 
+// ring header, followed by `capacity` messages and `capacity` lease flags;
+// the segment holds `lane_count` rings per shard for `shard_count` shards, `ring_stride` bytes apart.
+// Lane 0 is the highest priority, its EL_COUNT semaphore counts messages of the whole shard
 typedef struct
 {
-    message buffer[QUEUE_SIZE];
+    uint32_t magic;
+    uint32_t version;
+    uint32_t backing;
+    uint32_t clean_shutdown;
+    size_t segment_size;
+    size_t ring_stride;
+    int shard_count;
+    int shard_index;
+    int lane_count;
+    int lane_index;
+    int capacity;
+    sem_t sems[QUEUE_SEMS_COUNT];
     int head;
     int tail;
     int count;
     int added_count;
     int removed_count;
     int free_space;
+    int leased;
+    int release_head;
+    uint8_t *slot_leased;
+    // broadcast mode: messages are sequenced, every subscriber reads them in place at its own cursor
+    _Atomic uint64_t published;
+    _Atomic uint64_t cursors[MAX_SUBSCRIBERS];
+    message buffer[];
 } message_queue;
 
-message_queue* queue_init(int *shm_id);
+typedef struct
+{
+    message *messages;
+    int start;
+    int count;
+} queue_lease;
+
+int queue_parse_backing(const char *name, queue_backing *backing);
+
+const char* queue_backing_name(queue_backing backing);
+
+void queue_file_discard(const char *path);
+
+message_queue* queue_init(int capacity, queue_backing backing, int shards, int lanes, const char *path);
+
+message_queue* queue_shard(message_queue *q, int index);
 
-void queue_destroy(int shm_id, message_queue *q);
+message_queue* queue_lane(message_queue *shard, int lane);
+
+int queue_lane_for_type(message_queue *q, uint8_t type);
+
+void queue_sync(message_queue *q);
+
+void queue_destroy(message_queue *q);
 
 void enqueue(message_queue *q, message *msg);
 
-message* dequeue(message_queue *q);
+int dequeue_lease(message_queue *q, int max_count, queue_lease *lease);
+
+int dequeue_release(message_queue *q, queue_lease *lease);
+
+int steal_tail(message_queue *q, int max_count, message *out);
+
+int broadcast_subscribe(message_queue *q);
+
+void broadcast_unsubscribe(message_queue *q, int slot);
+
+uint64_t broadcast_min_cursor(message_queue *q);
+
+void broadcast_publish(message_queue *q, const message *msg);
+
+const message* broadcast_peek(message_queue *q, uint64_t seq);
 
 void print_queue_info(message_queue *q);
 
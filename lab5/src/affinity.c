@@ -0,0 +1,290 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include "./headers/affinity.h"
+#include "./headers/log.h"
+
+static const char* policy_options[AFFINITY_POLICIES] = {"none", "compact", "scatter", "list"};
+
+// one usable cpu with its place in the machine
+typedef struct {
+    int cpu;
+    int node;
+    int package;
+    int core;
+    // how many siblings of its core and how many other cores of its node come first, scatter sorts on them
+    int sibling_rank;
+    int core_rank;
+} affinity_place_t;
+
+static affinity_policy_t current_policy = AFFINITY_NONE;
+
+// cpus the process may run on, ordered by the policy
+static affinity_place_t places[CPU_SETSIZE];
+static int places_count = 0;
+
+// `list:` option, without a '/' both roles take turns on the producer list like compact pairs
+static int producer_list[AFFINITY_MAX_LIST];
+static int consumer_list[AFFINITY_MAX_LIST];
+static int producer_list_len = 0;
+static int consumer_list_len = 0;
+
+
+const char* affinity_policy_name(affinity_policy_t policy) {
+    if (policy < 0 || policy >= AFFINITY_POLICIES) return "unknown";
+
+    return policy_options[policy];
+}
+
+// "0-3,8" into cpus, stops at '/' or the end, NULL on bad syntax
+static const char* parse_cpu_list(const char* text, int* cpus, int* count) {
+    *count = 0;
+
+    while (1) {
+        char* end;
+        long from = strtol(text, &end, 10);
+        if (end == text || from < 0 || from >= CPU_SETSIZE) return NULL;
+
+        long to = from;
+        if (*end == '-') {
+            text = end + 1;
+            to = strtol(text, &end, 10);
+            if (end == text || to < from || to >= CPU_SETSIZE) return NULL;
+        }
+
+        for (long cpu = from; cpu <= to; cpu++) {
+            if (*count == AFFINITY_MAX_LIST) return NULL;
+            cpus[(*count)++] = (int)cpu;
+        }
+
+        if (*end != ',') return end;
+        text = end + 1;
+    }
+}
+
+// none | compact | scatter | list:PRODUCER CPUS[/CONSUMER CPUS]
+int affinity_parse(const char* option, affinity_policy_t* policy) {
+    for (int i = 0; i < AFFINITY_LIST; i++) {
+        if (strcmp(option, policy_options[i]) == 0) {
+            *policy = (affinity_policy_t)i;
+            return 1;
+        }
+    }
+
+    if (strncmp(option, "list:", 5) != 0) return 0;
+
+    const char* end = parse_cpu_list(option + 5, producer_list, &producer_list_len);
+    if (!end) return 0;
+
+    consumer_list_len = 0;
+    if (*end == '/') {
+        end = parse_cpu_list(end + 1, consumer_list, &consumer_list_len);
+        if (!end) return 0;
+    }
+
+    if (*end != '\0') return 0;
+
+    *policy = AFFINITY_LIST;
+    return 1;
+}
+
+
+// TOPOLOGY
+
+static int read_topology(int cpu, const char* name, int fallback) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+
+    FILE* file = fopen(path, "r");
+    if (!file) return fallback;
+
+    int value;
+    if (fscanf(file, "%d", &value) != 1) value = fallback;
+    fclose(file);
+
+    return value;
+}
+
+// the cpu directory holds a nodeN link on NUMA kernels, without one everything is node 0
+static int read_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR* dir = opendir(path);
+    if (!dir) return 0;
+
+    int node = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (sscanf(entry->d_name, "node%d", &node) == 1) break;
+    }
+    closedir(dir);
+
+    return node;
+}
+
+static int compare_compact(const void* a, const void* b) {
+    const affinity_place_t* x = a;
+    const affinity_place_t* y = b;
+
+    if (x->node != y->node) return x->node - y->node;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+// first one thread per core, alternating nodes, hyperthread siblings only after every core has one
+static int compare_scatter(const void* a, const void* b) {
+    const affinity_place_t* x = a;
+    const affinity_place_t* y = b;
+
+    if (x->sibling_rank != y->sibling_rank) return x->sibling_rank - y->sibling_rank;
+    if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+    return compare_compact(a, b);
+}
+
+static void discover_places() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("Affinity: failed to read the cpus of the process");
+        exit(EXIT_FAILURE);
+    }
+
+    places_count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+
+        affinity_place_t* place = &places[places_count++];
+        place->cpu = cpu;
+        place->node = read_node(cpu);
+        place->package = read_topology(cpu, "physical_package_id", 0);
+        place->core = read_topology(cpu, "core_id", cpu);
+    }
+
+    // ranks come from the compact order, where siblings and the cores of a node sit next to each other
+    qsort(places, places_count, sizeof(places[0]), compare_compact);
+
+    for (int i = 0; i < places_count; i++) {
+        affinity_place_t* place = &places[i];
+        affinity_place_t* before = i > 0 ? &places[i - 1] : NULL;
+
+        if (before && before->package == place->package && before->core == place->core) {
+            place->sibling_rank = before->sibling_rank + 1;
+            place->core_rank = before->core_rank;
+        } else {
+            place->sibling_rank = 0;
+            place->core_rank = before && before->node == place->node ? before->core_rank + 1 : 0;
+        }
+    }
+}
+
+static int is_usable(int cpu) {
+    for (int i = 0; i < places_count; i++) {
+        if (places[i].cpu == cpu) return 1;
+    }
+
+    return 0;
+}
+
+static int place_node(int cpu) {
+    for (int i = 0; i < places_count; i++) {
+        if (places[i].cpu == cpu) return places[i].node;
+    }
+
+    return 0;
+}
+
+static void check_list(const int* cpus, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!is_usable(cpus[i])) {
+            fprintf(stderr, "Affinity: cpu %d is offline or outside the cpus of the process\n", cpus[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// may be called again between benchmark runs with another policy
+void affinity_init(affinity_policy_t policy) {
+    current_policy = policy;
+    if (policy == AFFINITY_NONE) return;
+
+    discover_places();
+
+    if (policy == AFFINITY_SCATTER) {
+        qsort(places, places_count, sizeof(places[0]), compare_scatter);
+    } else if (policy == AFFINITY_LIST) {
+        check_list(producer_list, producer_list_len);
+        check_list(consumer_list, consumer_list_len);
+    }
+}
+
+
+// PLACEMENT
+
+// producer ind and consumer ind form a pair and take two neighbouring places of the order
+int affinity_cpu(affinity_role_t role, int ind) {
+    int slot = 2 * ind + (role == AFFINITY_CONSUMER);
+
+    switch (current_policy) {
+        case AFFINITY_COMPACT:
+        case AFFINITY_SCATTER:
+            return places_count ? places[slot % places_count].cpu : -1;
+        case AFFINITY_LIST:
+            if (consumer_list_len == 0) return producer_list[slot % producer_list_len];
+            if (role == AFFINITY_PRODUCER) return producer_list[ind % producer_list_len];
+            return consumer_list[ind % consumer_list_len];
+        default:
+            return -1;
+    }
+}
+
+// a thread pins itself before its first queue operation, so the magazines and slabs it touches first land on its node
+void affinity_apply(affinity_role_t role, int ind) {
+    int cpu = affinity_cpu(role, ind);
+    if (cpu < 0) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        log_printf("\nAffinity: failed to pin %s %d to cpu %d: %s\n",
+            role == AFFINITY_PRODUCER ? "producer" : "consumer", ind, cpu, strerror(error));
+    }
+}
+
+static void print_role(const char* name, affinity_role_t role, int count) {
+    printf("%s on", name);
+
+    for (int i = 0; i < count; i++) {
+        int cpu = affinity_cpu(role, i);
+        printf("%s cpu %d (node %d)", i ? "," : "", cpu, place_node(cpu));
+    }
+}
+
+void affinity_print(int producers, int consumers) {
+    if (current_policy == AFFINITY_NONE) {
+        printf("  placement: none, threads float over every cpu of the process\n");
+        return;
+    }
+
+    printf("  placement: %s, ", affinity_policy_name(current_policy));
+    print_role("producers", AFFINITY_PRODUCER, producers);
+    printf("; ");
+    print_role("consumers", AFFINITY_CONSUMER, consumers);
+
+    // a pair on one node passes its messages without crossing the interconnect
+    int pairs = producers < consumers ? producers : consumers;
+    int near = 0;
+    for (int i = 0; i < pairs; i++) {
+        if (place_node(affinity_cpu(AFFINITY_PRODUCER, i)) == place_node(affinity_cpu(AFFINITY_CONSUMER, i))) near++;
+    }
+
+    printf("; %d of %d pairs share a node\n", near, pairs);
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include "./headers/bench.h"
+#include "./headers/stats.h"
+
+static bench_counters_t slots[BENCH_MAX_SLOTS];
+
+static atomic_int running = 0;
+static uint64_t start_ns = 0;
+static uint64_t stop_ns = 0;
+static long start_switches = 0;
+static long stop_switches = 0;
+
+// blocked and lock times come from the per-thread stats, taken at both ends of the run
+static stats_snapshot_t start_stats;
+static stats_snapshot_t stop_stats;
+
+
+uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static long context_switches() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+void bench_start() {
+    memset(slots, 0, sizeof(slots));
+    start_switches = context_switches();
+    stats_snapshot(&start_stats);
+    start_ns = bench_now_ns();
+    atomic_store(&running, 1);
+}
+
+void bench_stop() {
+    atomic_store(&running, 0);
+    stop_ns = bench_now_ns();
+    stats_snapshot(&stop_stats);
+    stop_switches = context_switches();
+}
+
+int bench_is_running() {
+    return atomic_load_explicit(&running, memory_order_relaxed);
+}
+
+bench_counters_t* bench_slot(int slot) {
+    if (slot < 0 || slot >= BENCH_MAX_SLOTS) return NULL;
+
+    return &slots[slot];
+}
+
+
+// PACING
+
+void bench_pacer_init(bench_pacer_t* pacer, int rate) {
+    pacer->interval_ns = rate > 0 ? 1000000000ull / rate : 0;
+    pacer->next_ns = bench_now_ns();
+}
+
+void bench_pace(bench_pacer_t* pacer, int count) {
+    if (pacer->interval_ns == 0) return;
+
+    // absolute deadlines, so a late wakeup is caught up on instead of lowering the rate
+    pacer->next_ns += pacer->interval_ns * count;
+
+    struct timespec deadline;
+    deadline.tv_sec = pacer->next_ns / 1000000000ull;
+    deadline.tv_nsec = pacer->next_ns % 1000000000ull;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+}
+
+// a consumer that sat waiting for work can not bank the service time it did not use
+void bench_pacer_skip_idle(bench_pacer_t* pacer) {
+    uint64_t now = bench_now_ns();
+    if (pacer->next_ns < now) pacer->next_ns = now;
+}
+
+
+// LATENCY HISTOGRAM
+
+// log-linear buckets: 16 linear steps inside every power of two, about 6% resolution
+static int latency_bucket(uint64_t ns) {
+    if (ns < BENCH_SUB_BUCKETS) return (int)ns;
+
+    int msb = 63 - __builtin_clzll(ns);
+    int group = msb - 3;
+    int sub = (int)((ns >> (msb - 4)) & (BENCH_SUB_BUCKETS - 1));
+    return group * BENCH_SUB_BUCKETS + sub;
+}
+
+static uint64_t bucket_value(int bucket) {
+    int group = bucket / BENCH_SUB_BUCKETS;
+    int sub = bucket % BENCH_SUB_BUCKETS;
+
+    if (group == 0) return (uint64_t)sub;
+    return (uint64_t)(BENCH_SUB_BUCKETS + sub) << (group - 1);
+}
+
+void bench_record(bench_counters_t* counters, const message_queue_element_t* message) {
+    uint64_t now = bench_now_ns();
+    uint64_t latency = now > message->send_time ? now - message->send_time : 0;
+
+    counters->ops++;
+    counters->latency[latency_bucket(latency)]++;
+}
+
+static uint64_t percentile(const uint64_t* latency, uint64_t total, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * (double)total);
+    uint64_t seen = 0;
+
+    if (rank >= total) rank = total - 1;
+
+    for (int i = 0; i < BENCH_BUCKETS; i++) {
+        seen += latency[i];
+        if (seen > rank) return bucket_value(i);
+    }
+
+    return bucket_value(BENCH_BUCKETS - 1);
+}
+
+
+// REPORT
+
+static double print_blocked(const char* name, int threads, int from, int to, double seconds) {
+    stats_values_t start;
+    stats_values_t stop;
+    stats_sum(&start_stats, from, to, &start);
+    stats_sum(&stop_stats, from, to, &stop);
+
+    uint64_t wait_ns = (stop.free_space_wait_ns + stop.items_wait_ns) - (start.free_space_wait_ns + start.items_wait_ns);
+    uint64_t lock_ns = stop.lock_wait_ns - start.lock_wait_ns;
+    uint64_t hold_ns = stop.lock_hold_ns - start.lock_hold_ns;
+
+    double thread_ns = threads * seconds * 1e9;
+    double blocked = thread_ns > 0 ? 100.0 * (wait_ns + lock_ns) / thread_ns : 0.0;
+
+    printf("\n  %s blocked: %.1f%% of thread time (waiting %.1f ms, queue lock %.1f ms, lock held %.1f ms)",
+        name, blocked, wait_ns / 1e6, lock_ns / 1e6, hold_ns / 1e6);
+
+    return blocked;
+}
+
+void bench_report(const char* label, int producers, int consumers, int producer_slots, bench_summary_t* summary) {
+    static uint64_t latency[BENCH_BUCKETS];
+    uint64_t produced = 0;
+    uint64_t consumed = 0;
+    uint64_t total = 0;
+
+    memset(latency, 0, sizeof(latency));
+    for (int i = 0; i < BENCH_MAX_SLOTS; i++) {
+        if (i < producer_slots) {
+            produced += slots[i].ops;
+            continue;
+        }
+
+        consumed += slots[i].ops;
+        for (int j = 0; j < BENCH_BUCKETS; j++) {
+            latency[j] += slots[i].latency[j];
+            total += slots[i].latency[j];
+        }
+    }
+
+    double seconds = (stop_ns - start_ns) / 1e9;
+
+    printf("\n[%s] producers: %d, consumers: %d, duration: %.2f s", label, producers, consumers, seconds);
+    printf("\n  produced: %" PRIu64 " (%.0f ops/s), consumed: %" PRIu64 " (%.0f ops/s)", produced, produced / seconds, consumed, consumed / seconds);
+
+    if (total > 0) {
+        printf("\n  latency ns: p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64 ", p99.9 %" PRIu64 ", max %" PRIu64,
+            percentile(latency, total, 0.50), percentile(latency, total, 0.90),
+            percentile(latency, total, 0.99), percentile(latency, total, 0.999),
+            percentile(latency, total, 1.0));
+    }
+
+    long switches = stop_switches - start_switches;
+    double switches_per_message = consumed ? (double)switches / consumed : 0.0;
+    printf("\n  context switches: %ld (%.3f per message)", switches, switches_per_message);
+
+    double producers_blocked = print_blocked("producers", producers, 0, producer_slots, seconds);
+    double consumers_blocked = print_blocked("consumers", consumers, producer_slots, BENCH_MAX_SLOTS, seconds);
+    printf("\n");
+
+    if (!summary) return;
+
+    summary->produced_rate = produced / seconds;
+    summary->consumed_rate = consumed / seconds;
+    summary->p50_ns = total > 0 ? percentile(latency, total, 0.50) : 0;
+    summary->p99_ns = total > 0 ? percentile(latency, total, 0.99) : 0;
+    summary->switches_per_message = switches_per_message;
+    summary->producers_blocked = producers_blocked;
+    summary->consumers_blocked = consumers_blocked;
+}
+
+void bench_print_summaries(const char** labels, const bench_summary_t* summaries, int count) {
+    printf("\n%-44s %12s %12s %10s %10s %10s %10s %10s", "run", "produced/s", "consumed/s", "p50 ns", "p99 ns", "csw/msg", "prod blk%", "cons blk%");
+
+    for (int i = 0; i < count; i++) {
+        const bench_summary_t* summary = &summaries[i];
+
+        printf("\n%-44s %12.0f %12.0f %10" PRIu64 " %10" PRIu64 " %10.3f %10.1f %10.1f",
+            labels[i], summary->produced_rate, summary->consumed_rate, summary->p50_ns, summary->p99_ns,
+            summary->switches_per_message, summary->producers_blocked, summary->consumers_blocked);
+    }
+
+    printf("\n");
+}
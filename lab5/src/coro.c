@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "./headers/coro.h"
+
+// scheduler of the calling kernel thread, coro_yield and coro_park switch back to it
+static _Thread_local coro_sched_t* current_sched = NULL;
+
+void coro_main();
+
+
+// CONTEXT SWITCH
+
+#if CORO_FAST_SWITCH
+
+// pushes the callee-saved registers on the running stack, stores its top in *save and pops the other side's;
+// everything else is caller-saved, the compiler already spilled it around the call
+void coro_switch(void** save, void* resume);
+void coro_trampoline();
+
+__asm__(
+    ".text\n"
+    ".globl coro_switch\n"
+    ".type coro_switch, @function\n"
+    "coro_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size coro_switch, .-coro_switch\n"
+    ".globl coro_trampoline\n"
+    ".type coro_trampoline, @function\n"
+    "coro_trampoline:\n"
+    "    call coro_main@PLT\n"
+    "    ud2\n"
+    ".size coro_trampoline, .-coro_trampoline\n"
+);
+
+// a fresh stack looks like one coro_switch left behind: six zeroed registers, then a return into the trampoline;
+// the slot after it keeps rsp 16-byte aligned at the call into coro_main
+static void prepare_stack(coro_t* coro, char* stack) {
+    uintptr_t top = ((uintptr_t)(stack + CORO_STACK_SIZE)) & ~(uintptr_t)15;
+    uintptr_t* frame = (uintptr_t*)(top - 9 * sizeof(uintptr_t));
+
+    for (int i = 0; i < 9; i++) frame[i] = 0;
+    frame[6] = (uintptr_t)coro_trampoline;
+
+    coro->stack_pointer = frame;
+}
+
+static void switch_context(coro_t* from, coro_t* to) {
+    coro_switch(&from->stack_pointer, to->stack_pointer);
+}
+
+#else
+
+static void prepare_stack(coro_t* coro, char* stack) {
+    if (getcontext(&coro->context) != 0) {
+        perror("Coro: getcontext failed");
+        exit(EXIT_FAILURE);
+    }
+
+    coro->context.uc_stack.ss_sp = stack;
+    coro->context.uc_stack.ss_size = CORO_STACK_SIZE;
+    coro->context.uc_link = NULL;
+    makecontext(&coro->context, coro_main, 0);
+}
+
+static void switch_context(coro_t* from, coro_t* to) {
+    swapcontext(&from->context, &to->context);
+}
+
+#endif
+
+// first frame of every coroutine, it never returns: a finished coroutine switches away for good
+void coro_main() {
+    coro_sched_t* sched = current_sched;
+    coro_t* coro = sched->current;
+
+    coro->entry(coro->arg);
+
+    coro->finished = 1;
+    sched->finished++;
+    switch_context(coro, &sched->host);
+}
+
+
+// LISTS
+
+static void list_push(coro_list_t* list, coro_t* coro) {
+    coro->next = NULL;
+
+    if (list->tail) {
+        list->tail->next = coro;
+    } else {
+        list->head = coro;
+    }
+
+    list->tail = coro;
+    list->count++;
+}
+
+coro_t* coro_list_pop(coro_list_t* list) {
+    coro_t* coro = list->head;
+    if (!coro) return NULL;
+
+    list->head = coro->next;
+    if (!list->head) list->tail = NULL;
+    list->count--;
+
+    return coro;
+}
+
+
+// SCHEDULER
+
+// every stack comes out of one allocation; it is large enough to be mmapped, so untouched stack pages cost no memory,
+// and page alignment keeps a shallow coroutine within the single top page of its stack
+int coro_sched_init(coro_sched_t* sched, int capacity) {
+    sched->coros = calloc(capacity, sizeof(coro_t));
+    sched->stacks = aligned_alloc(CORO_PAGE_SIZE, (size_t)capacity * CORO_STACK_SIZE);
+
+    if (!sched->coros || !sched->stacks) {
+        free(sched->coros);
+        free(sched->stacks);
+        return 0;
+    }
+
+    sched->capacity = capacity;
+    sched->spawned = 0;
+    sched->finished = 0;
+    sched->ready = (coro_list_t){NULL, NULL, 0};
+    sched->current = NULL;
+    sched->switches = 0;
+
+    current_sched = sched;
+    return 1;
+}
+
+// only once every coroutine has finished
+void coro_sched_destroy(coro_sched_t* sched) {
+    free(sched->coros);
+    free(sched->stacks);
+
+    sched->coros = NULL;
+    sched->stacks = NULL;
+    current_sched = NULL;
+}
+
+coro_t* coro_spawn(coro_sched_t* sched, coro_entry_t entry, void* arg) {
+    if (sched->spawned == sched->capacity) return NULL;
+
+    coro_t* coro = &sched->coros[sched->spawned];
+    coro->entry = entry;
+    coro->arg = arg;
+    coro->finished = 0;
+    prepare_stack(coro, sched->stacks + (size_t)sched->spawned * CORO_STACK_SIZE);
+
+    sched->spawned++;
+    list_push(&sched->ready, coro);
+
+    return coro;
+}
+
+// one round: each coroutine that was ready when the round started runs until it yields, parks or finishes
+int coro_run_ready(coro_sched_t* sched) {
+    int round = sched->ready.count;
+
+    for (int i = 0; i < round; i++) {
+        coro_t* coro = coro_list_pop(&sched->ready);
+
+        sched->current = coro;
+        sched->switches++;
+        switch_context(&sched->host, coro);
+        sched->current = NULL;
+    }
+
+    return round;
+}
+
+// the caller goes to the back of the run queue
+void coro_yield() {
+    coro_sched_t* sched = current_sched;
+    coro_t* coro = sched->current;
+
+    list_push(&sched->ready, coro);
+    switch_context(coro, &sched->host);
+}
+
+// the caller sleeps on list until someone passes it to coro_wake
+void coro_park(coro_list_t* list) {
+    coro_sched_t* sched = current_sched;
+    coro_t* coro = sched->current;
+
+    list_push(list, coro);
+    switch_context(coro, &sched->host);
+}
+
+void coro_wake(coro_sched_t* sched, coro_t* coro) {
+    list_push(&sched->ready, coro);
+}
@@ -0,0 +1,27 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+// explicit lists hold at most this many cpus per role
+#define AFFINITY_MAX_LIST 64
+
+typedef enum {
+    AFFINITY_NONE,
+    AFFINITY_COMPACT,
+    AFFINITY_SCATTER,
+    AFFINITY_LIST,
+    AFFINITY_POLICIES
+} affinity_policy_t;
+
+typedef enum {
+    AFFINITY_PRODUCER,
+    AFFINITY_CONSUMER
+} affinity_role_t;
+
+const char* affinity_policy_name(affinity_policy_t policy);
+int affinity_parse(const char* option, affinity_policy_t* policy);
+void affinity_init(affinity_policy_t policy);
+int affinity_cpu(affinity_role_t role, int ind);
+void affinity_apply(affinity_role_t role, int ind);
+void affinity_print(int producers, int consumers);
+
+#endif
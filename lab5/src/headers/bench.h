@@ -0,0 +1,46 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <inttypes.h>
+#include "queue.h"
+
+#define BENCH_MAX_SLOTS 32
+#define BENCH_SUB_BUCKETS 16
+#define BENCH_BUCKETS (64 * BENCH_SUB_BUCKETS)
+
+// one slot per thread, aligned so producers and consumers never share a cache line
+typedef struct {
+    _Alignas(64) uint64_t ops;
+    uint64_t latency[BENCH_BUCKETS];
+} bench_counters_t;
+
+// paces one thread to a target rate in messages, a zero rate means unthrottled
+typedef struct {
+    uint64_t interval_ns;
+    uint64_t next_ns;
+} bench_pacer_t;
+
+// headline numbers of one run, kept so several runs can be printed side by side
+typedef struct {
+    double produced_rate;
+    double consumed_rate;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    double switches_per_message;
+    double producers_blocked;
+    double consumers_blocked;
+} bench_summary_t;
+
+uint64_t bench_now_ns();
+void bench_start();
+void bench_stop();
+int bench_is_running();
+bench_counters_t* bench_slot(int slot);
+void bench_pacer_init(bench_pacer_t* pacer, int rate);
+void bench_pace(bench_pacer_t* pacer, int count);
+void bench_pacer_skip_idle(bench_pacer_t* pacer);
+void bench_record(bench_counters_t* counters, const message_queue_element_t* message);
+void bench_report(const char* label, int producers, int consumers, int producer_slots, bench_summary_t* summary);
+void bench_print_summaries(const char** labels, const bench_summary_t* summaries, int count);
+
+#endif
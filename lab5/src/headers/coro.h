@@ -0,0 +1,63 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include <inttypes.h>
+
+// x86-64 switches stacks with a few instructions, anything else (or -DCORO_UCONTEXT) falls back to swapcontext,
+// which also saves the signal mask and so pays a syscall per switch
+#if defined(__x86_64__) && !defined(CORO_UCONTEXT)
+#define CORO_FAST_SWITCH 1
+#else
+#define CORO_FAST_SWITCH 0
+#include <ucontext.h>
+#endif
+
+// small stacks keep tens of thousands of coroutines cheap, their pages are only faulted in once touched
+#define CORO_STACK_SIZE (16 * 1024)
+#define CORO_PAGE_SIZE 4096
+
+typedef void (*coro_entry_t)(void* arg);
+
+typedef struct coro {
+#if CORO_FAST_SWITCH
+    void* stack_pointer;
+#else
+    ucontext_t context;
+#endif
+    coro_entry_t entry;
+    void* arg;
+    int finished;
+    struct coro* next;
+} coro_t;
+
+// FIFO of coroutines: the run queue, or whatever they park on
+typedef struct {
+    coro_t* head;
+    coro_t* tail;
+    int count;
+} coro_list_t;
+
+// one scheduler per kernel thread, nothing in it is shared with other threads
+typedef struct {
+    coro_t* coros;
+    char* stacks;
+    int capacity;
+    int spawned;
+    int finished;
+    coro_list_t ready;
+    coro_t* current;
+    // the kernel thread's own context while a coroutine runs
+    coro_t host;
+    uint64_t switches;
+} coro_sched_t;
+
+int coro_sched_init(coro_sched_t* sched, int capacity);
+void coro_sched_destroy(coro_sched_t* sched);
+coro_t* coro_spawn(coro_sched_t* sched, coro_entry_t entry, void* arg);
+int coro_run_ready(coro_sched_t* sched);
+void coro_yield();
+void coro_park(coro_list_t* list);
+void coro_wake(coro_sched_t* sched, coro_t* coro);
+coro_t* coro_list_pop(coro_list_t* list);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// power of two, lines that find the ring full are dropped and counted instead of blocking a worker
+#define LOG_RING_SIZE 1024
+#define LOG_LINE_SIZE 256
+// the writer thread hands the terminal at most this much per write
+#define LOG_BATCH_SIZE 16384
+
+typedef struct {
+    _Atomic size_t sequence;
+    int len;
+    char text[LOG_LINE_SIZE];
+} log_cell_t;
+
+void log_start();
+void log_stop();
+void log_flush();
+void log_printf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <inttypes.h>
+#include "queue.h"
+
+#define POOL_SLAB_ELEMENTS 256
+#define POOL_MAGAZINE_SIZE 32
+
+// slab pool for message elements: each thread keeps two magazines of free elements,
+// only swapping whole magazines with the shared depot (and carving new slabs) takes a lock
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t magazine_hits;
+    uint64_t depot_exchanges;
+    uint64_t slabs;
+    uint64_t full_magazines;
+} pool_stats_t;
+
+message_queue_element_t* pool_alloc();
+void pool_free(message_queue_element_t* element);
+void pool_thread_flush();
+void pool_get_stats(pool_stats_t* stats);
+void pool_print_stats();
+void pool_destroy();
+
+#endif
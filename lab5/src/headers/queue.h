@@ -0,0 +1,73 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define QUEUE_BASE_SIZE 10
+#define MESSAGE_SIZE 20
+#define QUEUE_SEGMENT_SIZE 16
+
+typedef struct {
+    uint8_t type;
+    uint16_t hash;
+    uint8_t size;
+    uint64_t send_time;
+    uint32_t data[MESSAGE_SIZE];
+} message_queue_element_t;
+
+// segmented ring: capacity is only a bound on len, so resizing never moves live elements
+typedef struct queue_segment {
+    struct queue_segment* next;
+    message_queue_element_t* messages[QUEUE_SEGMENT_SIZE];
+} queue_segment_t;
+
+typedef struct {
+    _Atomic size_t sequence;
+    message_queue_element_t* message;
+} queue_cell_t;
+
+typedef struct {
+    int head;
+    int tail;
+    int len;
+    int max_len;
+    int quiet;
+    queue_segment_t* head_segment;
+    queue_segment_t* tail_segment;
+    queue_segment_t* spare_segment;
+
+    // inline mode: messages are copied into a contiguous cache-line-aligned ring of max_len slots
+    int inline_storage;
+    message_queue_element_t* slots;
+
+    // lock-free mode: bounded MPMC ring of sequence-numbered cells, max_len is a power of two
+    int lock_free;
+    size_t mask;
+    queue_cell_t* cells;
+    _Alignas(64) _Atomic size_t enqueue_pos;
+    _Alignas(64) _Atomic size_t dequeue_pos;
+} message_queue_t;
+
+void queue_init(message_queue_t* queue);
+void queue_init_lock_free(message_queue_t* queue, int capacity);
+void queue_init_inline(message_queue_t* queue, int capacity);
+int queue_push(message_queue_element_t* new_message, message_queue_t* queue);
+message_queue_element_t* queue_pop(message_queue_t* queue);
+int queue_push_copy(const message_queue_element_t* message, message_queue_t* queue);
+int queue_pop_copy(message_queue_element_t* message, message_queue_t* queue);
+int queue_push_n(message_queue_element_t** messages, int n, message_queue_t* queue);
+int queue_pop_n(message_queue_element_t** messages, int n, message_queue_t* queue);
+void queue_print(message_queue_t* queue);
+message_queue_element_t* queue_generate_message();
+void queue_fill_message(message_queue_element_t* message);
+int queue_resize(message_queue_t* queue, int new_max_len);
+void queue_reduce(message_queue_t* queue);
+void queue_expand(message_queue_t* queue);
+void queue_free(message_queue_t* queue);
+int queue_len(message_queue_t* queue);
+int queue_is_full(message_queue_t* queue);
+int queue_is_empty(message_queue_t* queue);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+
+#define STATS_MAX_SLOTS 32
+#define STATS_DUMP_PERIOD_MS 1000
+
+// one slot per thread, written only by its owner and read by anyone without locks;
+// aligned so producers and consumers never share a cache line
+typedef struct {
+    _Alignas(64) _Atomic uint64_t pushes;
+    _Atomic uint64_t pops;
+    _Atomic uint64_t free_space_wait_ns;
+    _Atomic uint64_t items_wait_ns;
+    _Atomic uint64_t lock_wait_ns;
+    _Atomic uint64_t lock_hold_ns;
+} thread_stats_t;
+
+// plain copy of every slot at one moment
+typedef struct {
+    uint64_t pushes;
+    uint64_t pops;
+    uint64_t free_space_wait_ns;
+    uint64_t items_wait_ns;
+    uint64_t lock_wait_ns;
+    uint64_t lock_hold_ns;
+} stats_values_t;
+
+typedef struct {
+    stats_values_t slots[STATS_MAX_SLOTS];
+} stats_snapshot_t;
+
+thread_stats_t* stats_slot(int slot);
+void stats_add(_Atomic uint64_t* counter, uint64_t value);
+void stats_reset();
+void stats_snapshot(stats_snapshot_t* snapshot);
+void stats_sum(const stats_snapshot_t* snapshot, int from, int to, stats_values_t* total);
+void stats_print(int producer_slots);
+void stats_dump_header(FILE* file);
+void stats_dump_start(FILE* file, int period_ms, const char* label, int producer_slots);
+void stats_dump_stop();
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "queue.h"
+#include "bench.h"
+#include "stats.h"
+
+// failed attempts a spin-then-park thread makes before it sleeps on the cond
+#define SYNC_SPIN_LIMIT 256
+// spinning threads still give the CPU away this often, or an oversubscribed box only burns timeslices
+#define SYNC_SPIN_YIELD 64
+// semaphore waits wake up this often to notice that their thread was closed
+#define SYNC_STOP_POLL_NS 50000000
+
+typedef enum {
+    SYNC_SEMAPHORES,
+    SYNC_CONDVARS,
+    SYNC_SPIN_PARK,
+    SYNC_SPIN,
+    SYNC_STRATEGIES
+} sync_strategy_t;
+
+// asked while a thread waits, a non-zero answer makes it give up and return what it has done so far
+typedef int (*sync_stop_t)(int ind);
+// stop callback for callers that must never block, they get back what fitted right away
+int sync_no_wait(int ind);
+
+typedef struct {
+    sync_strategy_t strategy;
+    message_queue_t* queue;
+    pthread_mutex_t queue_mutex;
+
+    // semaphores: free slots and messages as tokens
+    sem_t free_space_sem;
+    sem_t items_sem;
+    // free_space_sem tokens still owed after a shrink, consumers pay them off instead of posting (guarded by queue_mutex)
+    int shrink_debt;
+
+    // condvars and spin-then-park: sleepers are counted, so the other side only signals when someone sleeps
+    pthread_cond_t free_space_cond;
+    pthread_cond_t items_cond;
+    atomic_int producers_waiting;
+    atomic_int consumers_waiting;
+} queue_sync_t;
+
+const char* sync_strategy_name(sync_strategy_t strategy);
+int sync_strategy_parse(const char* name, sync_strategy_t* strategy);
+
+void queue_sync_init(queue_sync_t* sync, message_queue_t* queue, sync_strategy_t strategy);
+void queue_sync_destroy(queue_sync_t* sync);
+void queue_sync_lock(queue_sync_t* sync, thread_stats_t* stats);
+void queue_sync_unlock(queue_sync_t* sync, thread_stats_t* stats);
+int queue_sync_push(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats);
+int queue_sync_pop(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats);
+int queue_sync_resize(queue_sync_t* sync, int new_max_len);
+int queue_sync_depth(queue_sync_t* sync, int* max_len);
+void queue_sync_wake_all(queue_sync_t* sync);
+
+#endif
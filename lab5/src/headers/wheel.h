@@ -0,0 +1,53 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <inttypes.h>
+#include "queue.h"
+#include "sync.h"
+#include "stats.h"
+
+// hierarchical timing wheel: 4 levels of 64 slots with 1 ms ticks cover delays of up to 64^4 ms (about 4.6 hours),
+// longer delays are cut to that
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_TICK_NS 1000000ull
+// producers wait for room once this many messages are pending, so a slow ready queue holds back the wheel too
+#define WHEEL_MAX_PENDING 65536
+// due messages go to the ready queue this many at a time
+#define WHEEL_BATCH 64
+#define WHEEL_CHUNK_TIMERS 256
+
+typedef struct wheel_timer {
+    struct wheel_timer* next;
+    uint64_t due_tick;
+    message_queue_element_t* message;
+    // an inline queue copies messages on push, so the timer keeps its own copy until then
+    message_queue_element_t copy;
+} wheel_timer_t;
+
+typedef struct wheel_chunk {
+    struct wheel_chunk* next;
+    wheel_timer_t timers[WHEEL_CHUNK_TIMERS];
+} wheel_chunk_t;
+
+typedef struct {
+    uint64_t scheduled;
+    uint64_t delivered;
+    uint64_t dropped;
+    uint64_t cascaded;
+    uint64_t expired;
+    uint64_t batches;
+    uint64_t lateness_ns;
+    uint64_t max_lateness_ns;
+    int pending;
+    int peak_pending;
+} wheel_stats_t;
+
+void wheel_start(queue_sync_t* sync);
+void wheel_stop();
+int wheel_push(message_queue_element_t* message, uint64_t delay_ns, sync_stop_t stop, int ind, thread_stats_t* stats);
+void wheel_get_stats(wheel_stats_t* stats);
+void wheel_print_stats();
+
+#endif
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include "./headers/log.h"
+
+// MPSC RING (any thread writes lines, the writer thread drains them)
+
+static log_cell_t cells[LOG_RING_SIZE];
+static _Alignas(64) _Atomic size_t enqueue_pos = 0;
+static _Alignas(64) size_t dequeue_pos = 0;
+
+// one token per published line, the writer sleeps on it while the ring is empty
+static sem_t lines;
+static atomic_int running = 0;
+static _Atomic unsigned long dropped = 0;
+static pthread_t writer;
+
+// log_flush waits here until the writer has put everything older on the terminal
+static pthread_mutex_t written_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t written_cond = PTHREAD_COND_INITIALIZER;
+static size_t written_pos = 0;
+
+
+// claims the next cell, NULL when the ring is full
+static log_cell_t* log_claim(size_t* claimed) {
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        log_cell_t* cell = &cells[pos & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *claimed = pos;
+                return cell;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static void log_publish(log_cell_t* cell, size_t pos) {
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    sem_post(&lines);
+}
+
+// formats straight into the claimed cell, a worker never takes a lock to log
+void log_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    // before log_start and after log_stop lines go straight to stdout
+    if (!atomic_load_explicit(&running, memory_order_acquire)) {
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+
+    size_t pos;
+    log_cell_t* cell = log_claim(&pos);
+    if (!cell) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        va_end(args);
+        return;
+    }
+
+    int len = vsnprintf(cell->text, LOG_LINE_SIZE, format, args);
+    cell->len = len < 0 ? 0 : len >= LOG_LINE_SIZE ? LOG_LINE_SIZE - 1 : len;
+    va_end(args);
+
+    log_publish(cell, pos);
+}
+
+
+// WRITER
+
+static void mark_written() {
+    pthread_mutex_lock(&written_mutex);
+    written_pos = dequeue_pos;
+    pthread_cond_broadcast(&written_cond);
+    pthread_mutex_unlock(&written_mutex);
+}
+
+// one fwrite per batch of lines instead of one terminal write per printf
+static void* writer_processing(void* arg) {
+    (void)arg;
+
+    static char batch[LOG_BATCH_SIZE];
+    int stopping = 0;
+
+    while (!stopping) {
+        sem_wait(&lines);
+
+        size_t used = 0;
+        do {
+            log_cell_t* cell = &cells[dequeue_pos & (LOG_RING_SIZE - 1)];
+
+            // the token may belong to a later cell, the one in front is published by a thread still formatting it
+            while (atomic_load_explicit(&cell->sequence, memory_order_acquire) != dequeue_pos + 1) sched_yield();
+
+            // a cell with a negative len is the stop request of log_stop
+            if (cell->len < 0) {
+                stopping = 1;
+            } else {
+                if (used + cell->len > sizeof(batch)) {
+                    fwrite(batch, 1, used, stdout);
+                    used = 0;
+                }
+
+                memcpy(batch + used, cell->text, cell->len);
+                used += cell->len;
+            }
+
+            atomic_store_explicit(&cell->sequence, dequeue_pos + LOG_RING_SIZE, memory_order_release);
+            dequeue_pos++;
+        } while (!stopping && sem_trywait(&lines) == 0);
+
+        fwrite(batch, 1, used, stdout);
+
+        unsigned long lost = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+        if (lost) printf("\nLog: %lu lines dropped, the ring was full\n", lost);
+
+        fflush(stdout);
+        mark_written();
+    }
+
+    return NULL;
+}
+
+
+// START/STOP
+
+void log_start() {
+    for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+        atomic_init(&cells[i].sequence, i);
+    }
+
+    atomic_store(&enqueue_pos, 0);
+    dequeue_pos = 0;
+    written_pos = 0;
+
+    if (sem_init(&lines, 0, 0) != 0) {
+        perror("Log: semaphore creation failed");
+        exit(1);
+    }
+
+    fflush(stdout);
+    atomic_store(&running, 1);
+
+    if (pthread_create(&writer, NULL, writer_processing, NULL) != 0) {
+        atomic_store(&running, 0);
+        sem_destroy(&lines);
+        printf("\nLog: failed to start the writer thread, printing directly");
+    }
+}
+
+// everything logged before the call is on the terminal when it returns
+void log_flush() {
+    if (!atomic_load(&running)) {
+        fflush(stdout);
+        return;
+    }
+
+    size_t target = atomic_load(&enqueue_pos);
+
+    pthread_mutex_lock(&written_mutex);
+    while (written_pos < target) {
+        pthread_cond_wait(&written_cond, &written_mutex);
+    }
+    pthread_mutex_unlock(&written_mutex);
+}
+
+// only once no other thread logs any more
+void log_stop() {
+    if (!atomic_exchange(&running, 0)) return;
+
+    size_t pos;
+    log_cell_t* cell;
+    while (!(cell = log_claim(&pos))) sched_yield();
+
+    cell->len = -1;
+    log_publish(cell, pos);
+
+    pthread_join(writer, NULL);
+    sem_destroy(&lines);
+}
@@ -0,0 +1,1115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "./headers/queue.h"
+#include "./headers/pool.h"
+#include "./headers/bench.h"
+#include "./headers/sync.h"
+#include "./headers/stats.h"
+#include "./headers/log.h"
+#include "./headers/affinity.h"
+#include "./headers/coro.h"
+#include "./headers/wheel.h"
+
+#define MAX_CONSUMER_THREADS 10
+#define MAX_PRODUCER_THREADS 10
+#define MAX_BATCH_SIZE 64
+// logical producers or consumers per side in green mode, each one costs a coroutine stack
+#define MAX_GREEN_ACTORS 100000
+
+// autoscaler: adds a consumer after a few deep ticks, retires one only after a long run of idle ones
+#define AUTOSCALE_TICK_MS 100
+#define AUTOSCALE_UP_TICKS 2
+#define AUTOSCALE_DOWN_TICKS 20
+#define AUTOSCALE_HIGH_DEPTH 50
+#define AUTOSCALE_LOW_DEPTH 10
+#define AUTOSCALE_RETIRE_BUSY 75
+
+int consumers_count = 0;
+int producers_count = 0;
+
+pthread_t consumers[MAX_CONSUMER_THREADS];
+pthread_t producers[MAX_PRODUCER_THREADS];
+
+int consumers_working[MAX_CONSUMER_THREADS];
+int producers_working[MAX_PRODUCER_THREADS];
+
+pthread_mutex_t consumers_working_mutex;
+pthread_mutex_t producers_working_mutex;
+
+message_queue_t* message_queue;
+queue_sync_t queue_sync;
+sync_strategy_t sync_strategy = SYNC_CONDVARS;
+int lock_free_mode = 0;
+int inline_mode = 0;
+int batch_size = 1;
+affinity_policy_t affinity_policy = AFFINITY_NONE;
+
+// benchmark mode: threads run paced or unthrottled instead of sleeping, for a fixed duration
+int bench_mode = 0;
+int bench_seconds = 0;
+int bench_producers = 1;
+int bench_consumers = 1;
+int producer_rate = 0;
+int consumer_rate = 0;
+int bench_all_strategies = 0;
+int bench_all_placements = 0;
+_Thread_local bench_counters_t* bench_local = NULL;
+_Thread_local thread_stats_t* stats_local = NULL;
+
+// green mode: logical producers and consumers run as coroutines multiplexed on the kernel threads
+int green_producers = 0;
+int green_consumers = 0;
+_Atomic uint64_t green_switches = 0;
+
+// delayed delivery: producers schedule every message through the timer wheel with a random delay up to this
+int delay_max_ms = 0;
+_Thread_local unsigned int delay_seed = 0;
+
+// periodic CSV dump of the per-thread stats
+FILE* stats_file = NULL;
+int stats_period_ms = STATS_DUMP_PERIOD_MS;
+
+// consumer time not spent on messages (pacing, the interactive sleep and waiting in queue_sync_pop),
+// the autoscaler's measure of how idle consumers are
+typedef struct {
+    _Alignas(64) _Atomic uint64_t idle_ns;
+    _Atomic uint64_t idle_start;
+} consumer_load_t;
+
+int autoscale_mode = 0;
+int autoscale_min = 1;
+int autoscale_max = MAX_CONSUMER_THREADS;
+atomic_int autoscaler_running = 0;
+pthread_t autoscaler;
+consumer_load_t consumers_load[MAX_CONSUMER_THREADS];
+
+// the autoscaler and the command loop both add and remove consumers
+pthread_mutex_t consumers_scale_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int autoscale_added = 0;
+int autoscale_retired = 0;
+int autoscale_peak = 0;
+uint64_t autoscale_ticks = 0;
+uint64_t autoscale_consumer_ticks = 0;
+
+
+// SEMS\MUTEX INIT AND END
+
+void sync_init() {
+    if (
+        pthread_mutex_init(&consumers_working_mutex, NULL) != 0
+        || pthread_mutex_init(&producers_working_mutex, NULL) != 0
+    ) {
+        perror("Mutexes creation failed");
+        exit(1);
+    }
+
+    queue_sync_init(&queue_sync, message_queue, sync_strategy);
+    if (delay_max_ms) wheel_start(&queue_sync);
+}
+
+void sync_destroy() {
+    queue_sync_destroy(&queue_sync);
+    pthread_mutex_destroy(&consumers_working_mutex);
+    pthread_mutex_destroy(&producers_working_mutex);
+}
+
+
+
+// GREEN ACTORS
+
+typedef struct green_host green_host_t;
+
+// one logical producer or consumer, it parks instead of blocking the kernel thread it shares
+typedef struct {
+    coro_t* coro;
+    green_host_t* host;
+    message_queue_element_t* message;
+    // inline mode copies messages through here
+    message_queue_element_t buffer;
+    // set by the host when it moved the message for a parked actor
+    int delivered;
+} green_actor_t;
+
+struct green_host {
+    int ind;
+    int producer;
+    sync_stop_t stop;
+    int stopping;
+    bench_pacer_t* pacer;
+    coro_sched_t sched;
+    // actors that found the queue full (producers) or empty (consumers)
+    coro_list_t parked;
+};
+
+int green_share(int actors, int threads, int ind) {
+    return actors / threads + (ind < actors % threads);
+}
+
+// never blocks: a full queue parks the actor until the host pushed the message for it or it is worth another try
+int green_push(green_actor_t* actor) {
+    green_host_t* host = actor->host;
+
+    while (!host->stopping) {
+        if (queue_sync_push(&queue_sync, &actor->message, 1, sync_no_wait, host->ind, stats_local)) return 1;
+
+        actor->delivered = 0;
+        coro_park(&host->parked);
+        if (actor->delivered) return 1;
+    }
+
+    return 0;
+}
+
+message_queue_element_t* green_pop(green_actor_t* actor) {
+    green_host_t* host = actor->host;
+
+    while (!host->stopping) {
+        message_queue_element_t* message = &actor->buffer;
+        if (queue_sync_pop(&queue_sync, &message, 1, sync_no_wait, host->ind, stats_local)) return message;
+
+        actor->delivered = 0;
+        coro_park(&host->parked);
+        if (actor->delivered) return actor->message;
+    }
+
+    return NULL;
+}
+
+void green_producer(void* arg) {
+    green_actor_t* actor = arg;
+    green_host_t* host = actor->host;
+
+    while (!host->stopping) {
+        bench_pace(host->pacer, 1);
+
+        if (inline_mode) {
+            actor->message = &actor->buffer;
+            queue_fill_message(actor->message);
+        } else {
+            actor->message = queue_generate_message();
+        }
+
+        if (!green_push(actor)) {
+            if (!inline_mode) pool_free(actor->message);
+            break;
+        }
+
+        if (bench_is_running()) bench_local->ops++;
+        coro_yield();
+    }
+}
+
+void green_consumer(void* arg) {
+    green_actor_t* actor = arg;
+    green_host_t* host = actor->host;
+
+    while (!host->stopping) {
+        bench_pace(host->pacer, 1);
+
+        message_queue_element_t* message = green_pop(actor);
+        if (!message) break;
+
+        if (bench_is_running()) bench_record(bench_local, message);
+        if (!inline_mode) pool_free(message);
+
+        coro_yield();
+    }
+}
+
+// wakes only as many parked actors as the queue can serve right now, the rest would only park again
+void green_wake_parked(green_host_t* host) {
+    if (host->parked.count == 0) return;
+
+    int max_len;
+    int depth = queue_sync_depth(&queue_sync, &max_len);
+    int room = host->producer ? max_len - depth : depth;
+
+    for (; room > 0 && host->parked.count > 0; room--) {
+        coro_wake(&host->sched, coro_list_pop(&host->parked));
+    }
+}
+
+// every actor of the thread is parked: the host blocks once for up to a batch of them, with the queue's wait strategy
+void green_deliver(green_host_t* host) {
+    green_actor_t* actors[MAX_BATCH_SIZE];
+    message_queue_element_t* batch[MAX_BATCH_SIZE];
+    int n = 0;
+
+    while (n < batch_size && host->parked.count > 0) {
+        actors[n] = coro_list_pop(&host->parked)->arg;
+        batch[n] = host->producer ? actors[n]->message : &actors[n]->buffer;
+        n++;
+    }
+
+    int moved = host->producer
+        ? queue_sync_push(&queue_sync, batch, n, host->stop, host->ind, stats_local)
+        : queue_sync_pop(&queue_sync, batch, n, host->stop, host->ind, stats_local);
+
+    if (!host->producer && bench_mode) bench_pacer_skip_idle(host->pacer);
+
+    for (int i = 0; i < n; i++) {
+        actors[i]->delivered = i < moved;
+        actors[i]->message = batch[i];
+        coro_wake(&host->sched, actors[i]->coro);
+    }
+}
+
+void green_host_processing(int ind, int count, int producer, sync_stop_t stop, bench_pacer_t* pacer) {
+    green_host_t host = {.ind = ind, .producer = producer, .stop = stop, .pacer = pacer};
+    green_actor_t* actors = calloc(count, sizeof(green_actor_t));
+
+    if (!actors || !coro_sched_init(&host.sched, count)) {
+        free(actors);
+        log_printf("\n%s (ind %d): no memory for %d green actors\n", producer ? "Producer" : "Consumer", ind, count);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        actors[i].host = &host;
+        actors[i].coro = coro_spawn(&host.sched, producer ? green_producer : green_consumer, &actors[i]);
+    }
+
+    // the stop check takes a mutex, once per round of the run queue is enough
+    while (!(host.stopping = stop(ind))) {
+        green_wake_parked(&host);
+
+        if (host.sched.ready.count == 0) {
+            green_deliver(&host);
+            continue;
+        }
+
+        coro_run_ready(&host.sched);
+    }
+
+    // every parked actor runs once more to let go of its message and finish
+    while (host.sched.finished < host.sched.spawned) {
+        coro_t* coro;
+        while ((coro = coro_list_pop(&host.parked))) coro_wake(&host.sched, coro);
+
+        coro_run_ready(&host.sched);
+    }
+
+    atomic_fetch_add(&green_switches, host.sched.switches);
+    coro_sched_destroy(&host.sched);
+    free(actors);
+}
+
+
+// THREAD PROCESSING
+
+int checkTermProducer(int ind) {
+    pthread_mutex_lock(&producers_working_mutex);
+    int is_closing = producers_working[ind] == 0 || (bench_mode && !bench_is_running());
+    pthread_mutex_unlock(&producers_working_mutex);
+
+    return is_closing;
+}
+
+void fill_batch(message_queue_element_t** batch, message_queue_element_t* buffers) {
+    for (int i = 0; i < batch_size; i++) {
+        if (inline_mode) {
+            batch[i] = &buffers[i];
+            queue_fill_message(batch[i]);
+        } else {
+            batch[i] = queue_generate_message();
+        }
+    }
+}
+
+void drop_batch(message_queue_element_t** batch, int from) {
+    if (inline_mode) return;
+
+    for (int i = from; i < batch_size; i++) {
+        pool_free(batch[i]);
+    }
+}
+
+// random delay in whole microseconds, the wheel rounds it up to its tick
+uint64_t next_delay_ns() {
+    if (delay_seed == 0) delay_seed = (unsigned int)rand() | 1;
+
+    return (uint64_t)(rand_r(&delay_seed) % (delay_max_ms * 1000 + 1)) * 1000;
+}
+
+int schedule_batch(message_queue_element_t** batch, int ind) {
+    for (int i = 0; i < batch_size; i++) {
+        if (!wheel_push(batch[i], next_delay_ns(), checkTermProducer, ind, stats_local)) return i;
+    }
+
+    return batch_size;
+}
+
+void* producer_thread_processing(void* arg) {
+    int ind = *(int*)arg;
+    free(arg);
+
+    message_queue_element_t buffers[MAX_BATCH_SIZE];
+    message_queue_element_t* batch[MAX_BATCH_SIZE];
+
+    affinity_apply(AFFINITY_PRODUCER, ind);
+    stats_local = stats_slot(ind);
+
+    bench_pacer_t pacer;
+    if (bench_mode) {
+        bench_local = bench_slot(ind);
+        bench_pacer_init(&pacer, producer_rate);
+    }
+
+    if (green_producers) {
+        green_host_processing(ind, green_share(green_producers, bench_producers, ind), 1, checkTermProducer, &pacer);
+    } else {
+        while (!checkTermProducer(ind)) {
+            if (bench_mode) {
+                bench_pace(&pacer, batch_size);
+            } else {
+                sleep(3);
+            }
+
+            fill_batch(batch, buffers);
+
+            int pushed = delay_max_ms
+                ? schedule_batch(batch, ind)
+                : queue_sync_push(&queue_sync, batch, batch_size, checkTermProducer, ind, stats_local);
+            if (pushed < batch_size) {
+                drop_batch(batch, pushed);
+                break;
+            }
+
+            if (bench_mode) {
+                if (bench_is_running()) bench_local->ops += batch_size;
+            } else if (batch_size == 1) {
+                log_printf("\nProducer (ind %d): %s item\n", ind, delay_max_ms ? "scheduled" : "pushed");
+            } else {
+                log_printf("\nProducer (ind %d): %s %d items\n", ind, delay_max_ms ? "scheduled" : "pushed", batch_size);
+            }
+        }
+    }
+
+    pool_thread_flush();
+    log_printf("\nProducer (ind %d): Closing\n", ind);
+    return NULL;
+}
+
+
+int checkTermConsumer(int ind) {
+    pthread_mutex_lock(&consumers_working_mutex);
+    int is_closing = consumers_working[ind] == 0 || (bench_mode && !bench_is_running());
+    pthread_mutex_unlock(&consumers_working_mutex);
+
+    return is_closing;
+}
+
+// the whole message goes out as one log line, not one write per digit
+void log_message(int ind, const message_queue_element_t* message) {
+    char digits[LOG_LINE_SIZE];
+    size_t used = 0;
+
+    for (int i = 0; i < message->size && used < sizeof(digits); i++) {
+        int len = snprintf(digits + used, sizeof(digits) - used, "%d", message->data[i]);
+        if (len < 0) break;
+        used += len;
+    }
+    digits[used < sizeof(digits) ? used : sizeof(digits) - 1] = '\0';
+
+    log_printf("\nConsumer (ind %d): popped from queue: %s\n", ind, digits);
+}
+
+void* consumer_thread_processing(void* arg) {
+    int ind = *(int*)arg;
+    free(arg);
+
+    message_queue_element_t buffers[MAX_BATCH_SIZE];
+    message_queue_element_t* batch[MAX_BATCH_SIZE];
+    for (int i = 0; i < MAX_BATCH_SIZE; i++) {
+        batch[i] = &buffers[i];
+    }
+
+    affinity_apply(AFFINITY_CONSUMER, ind);
+    stats_local = stats_slot(MAX_PRODUCER_THREADS + ind);
+
+    bench_pacer_t pacer;
+    if (bench_mode) {
+        bench_local = bench_slot(MAX_PRODUCER_THREADS + ind);
+        bench_pacer_init(&pacer, consumer_rate);
+    }
+
+    // consumers pace on what they actually took, a short batch must not eat the budget of a full one
+    int popped = 0;
+
+    if (green_consumers) {
+        green_host_processing(ind, green_share(green_consumers, bench_consumers, ind), 0, checkTermConsumer, &pacer);
+    } else {
+        while (!checkTermConsumer(ind)) {
+            // everything up to the end of the pop is idle, only handling the batch counts as busy
+            if (autoscale_mode) atomic_store(&consumers_load[ind].idle_start, bench_now_ns());
+
+            if (bench_mode) {
+                bench_pace(&pacer, popped);
+            } else {
+                sleep(4);
+            }
+
+            popped = queue_sync_pop(&queue_sync, batch, batch_size, checkTermConsumer, ind, stats_local);
+
+            if (autoscale_mode) {
+                // the autoscaler may have moved idle_start forward after counting the part it already saw
+                uint64_t idle_start = atomic_exchange(&consumers_load[ind].idle_start, 0);
+                atomic_fetch_add(&consumers_load[ind].idle_ns, bench_now_ns() - idle_start);
+            }
+
+            if (!popped) break;
+
+            if (bench_mode) bench_pacer_skip_idle(&pacer);
+
+            for (int j = 0; j < popped; j++) {
+                message_queue_element_t* data = batch[j];
+
+                if (bench_mode) {
+                    if (bench_is_running()) bench_record(bench_local, data);
+                } else {
+                    log_message(ind, data);
+                }
+
+                if (!inline_mode) {
+                    pool_free(data);
+                    batch[j] = &buffers[j];
+                }
+            }
+        }
+    }
+
+    pool_thread_flush();
+    log_printf("\nConsumer (ind %d): Closing\n", ind);
+    return NULL;
+}
+
+
+
+// THREAD CREATION
+
+void create_thread(int opt) {
+    // opt = +1 - producer
+    // opt = -1 - consumer
+
+    int* thread_index;
+
+    if (opt == 1) {
+        if (producers_count < MAX_PRODUCER_THREADS) {
+            thread_index = malloc(sizeof(int));
+            *thread_index = 0;
+
+            while (producers_working[*thread_index] != 0) (*thread_index)++;
+
+            producers_working[*thread_index] = 1;
+
+            if (pthread_create(&producers[*thread_index], NULL, producer_thread_processing, thread_index) != 0) {
+                producers_working[*thread_index] = 0;
+                free(thread_index);
+
+                printf("Parent: Failure creation of producer thread\n");
+            } else {
+                producers_count++;
+                printf("Parent: Created new producer thread\n");
+            }
+        } else {
+            printf("Parent: producers limit is reached");
+        }
+    } else if (opt == -1) {
+        if (consumers_count < MAX_CONSUMER_THREADS) {
+            thread_index = malloc(sizeof(int));
+            *thread_index = 0;
+
+            while (consumers_working[*thread_index] != 0) (*thread_index)++;
+
+            consumers_working[*thread_index] = 1;
+
+            if (pthread_create(&consumers[*thread_index], NULL, consumer_thread_processing, thread_index) != 0) {
+                consumers_working[*thread_index] = 0;
+                free(thread_index);
+
+                printf("Parent: Failure creation of consumer pthread\n");
+            } else {
+                consumers_count++;
+                printf("Parent: Created new consumer pthread\n");
+            }
+        } else {
+            printf("Parent: consumers limit is reached");
+        }
+    } else {
+        printf("Parent: invalid pthread create option.");
+    }
+}
+
+
+// CLOSING TREADS
+
+// every wait strategy re-checks the working flag while blocked, so closing never needs pthread_cancel
+void close_thread_by_ind(int ind, int type) {
+    if (type == 1) {
+        pthread_mutex_lock(&producers_working_mutex);
+        if (producers_count > 0 && ind >= 0 && ind < MAX_PRODUCER_THREADS && producers_working[ind] == 1) {
+            producers_working[ind] = 0;
+            pthread_mutex_unlock(&producers_working_mutex);
+
+            queue_sync_wake_all(&queue_sync);
+            pthread_join(producers[ind], NULL);
+            log_flush();
+
+            pthread_mutex_lock(&producers_working_mutex);
+            producers_count--;
+            pthread_mutex_unlock(&producers_working_mutex);
+
+            printf("Parent: closed %dth producer thread. Remaining: %d\n", ind, producers_count);
+        } else {
+            pthread_mutex_unlock(&producers_working_mutex);
+            printf("Parent: No producers thread to close\n");
+        }
+    } else if (type == -1) {
+        pthread_mutex_lock(&consumers_working_mutex);
+        if (consumers_count > 0 && ind >= 0 && ind < MAX_CONSUMER_THREADS && consumers_working[ind] == 1) {
+            consumers_working[ind] = 0;
+            pthread_mutex_unlock(&consumers_working_mutex);
+
+            queue_sync_wake_all(&queue_sync);
+            pthread_join(consumers[ind], NULL);
+            log_flush();
+
+            pthread_mutex_lock(&consumers_working_mutex);
+            consumers_count--;
+            pthread_mutex_unlock(&consumers_working_mutex);
+
+            printf("Parent: closed %dth consumer thread. Remaining: %d\n", ind, consumers_count);
+        } else {
+            pthread_mutex_unlock(&consumers_working_mutex);
+            printf("Parent: No consumers thread to close\n");
+        }
+    } else {
+        printf("Parent: invalid pthread type\n");
+    }
+}
+
+void close_all_threads(int type) {
+    if (type == 1) {
+        while (producers_count > 0) {
+            close_thread_by_ind(producers_count - 1, type);
+        }
+
+        printf("Parent: Closed all producers\n");
+    } else if (type == -1) {
+        while (consumers_count > 0) {
+            close_thread_by_ind(consumers_count - 1, type);
+        }
+
+        printf("Parent: Closed all consumers\n");
+    } else {
+        printf("Parent: invalid process type\n");
+    }
+}
+
+
+// AUTOSCALER
+
+// fraction of the last tick the current consumers spent idle, in percent
+double collect_consumers_idle(uint64_t tick_ns) {
+    uint64_t now = bench_now_ns();
+    uint64_t idle_ns = 0;
+
+    for (int i = 0; i < MAX_CONSUMER_THREADS; i++) {
+        idle_ns += atomic_exchange(&consumers_load[i].idle_ns, 0);
+
+        // a consumer sleeping or blocked for the whole tick has not reported anything yet, count its idle time so far
+        uint64_t idle_start = atomic_load(&consumers_load[i].idle_start);
+        if (idle_start && idle_start < now && atomic_compare_exchange_strong(&consumers_load[i].idle_start, &idle_start, now)) {
+            idle_ns += now - idle_start;
+        }
+    }
+
+    if (consumers_count == 0) return 0.0;
+
+    double idle = 100.0 * idle_ns / ((double)consumers_count * tick_ns);
+    return idle > 100.0 ? 100.0 : idle;
+}
+
+void* autoscaler_processing(void* arg) {
+    (void)arg;
+
+    const uint64_t tick_ns = AUTOSCALE_TICK_MS * 1000000ull;
+    struct timespec tick = {AUTOSCALE_TICK_MS / 1000, (AUTOSCALE_TICK_MS % 1000) * 1000000L};
+    int deep_ticks = 0;
+    int idle_ticks = 0;
+
+    while (atomic_load(&autoscaler_running)) {
+        nanosleep(&tick, NULL);
+
+        int max_len;
+        int depth = queue_sync_depth(&queue_sync, &max_len);
+
+        pthread_mutex_lock(&consumers_scale_mutex);
+        double idle = collect_consumers_idle(tick_ns);
+
+        // separate thresholds for growing and shrinking, so a queue hovering around one of them does not flap
+        deep_ticks = depth * 100 >= max_len * AUTOSCALE_HIGH_DEPTH ? deep_ticks + 1 : 0;
+        // a consumer is only retired when the ones left would still be at most AUTOSCALE_RETIRE_BUSY percent busy
+        double busy_after = consumers_count > 1 ? (100.0 - idle) * consumers_count / (consumers_count - 1) : 100.0;
+        idle_ticks = depth * 100 <= max_len * AUTOSCALE_LOW_DEPTH && busy_after <= AUTOSCALE_RETIRE_BUSY ? idle_ticks + 1 : 0;
+
+        if (consumers_count < autoscale_min || (deep_ticks >= AUTOSCALE_UP_TICKS && consumers_count < autoscale_max)) {
+            if (!bench_mode) log_printf("\nAutoscaler: depth %d/%d, consumers idle %.0f%%, adding a consumer\n", depth, max_len, idle);
+            create_thread(-1);
+            autoscale_added++;
+            deep_ticks = 0;
+            idle_ticks = 0;
+        } else if (consumers_count > autoscale_max || (idle_ticks >= AUTOSCALE_DOWN_TICKS && consumers_count > autoscale_min)) {
+            if (!bench_mode) log_printf("\nAutoscaler: depth %d/%d, consumers idle %.0f%%, retiring a consumer\n", depth, max_len, idle);
+            close_thread_by_ind(consumers_count - 1, -1);
+            autoscale_retired++;
+            idle_ticks = 0;
+        }
+
+        if (consumers_count > autoscale_peak) autoscale_peak = consumers_count;
+        autoscale_ticks++;
+        autoscale_consumer_ticks += consumers_count;
+        pthread_mutex_unlock(&consumers_scale_mutex);
+    }
+
+    return NULL;
+}
+
+void autoscaler_start() {
+    autoscale_added = 0;
+    autoscale_retired = 0;
+    autoscale_peak = 0;
+    autoscale_ticks = 0;
+    autoscale_consumer_ticks = 0;
+
+    pthread_mutex_lock(&consumers_scale_mutex);
+    while (consumers_count < autoscale_min) create_thread(-1);
+    autoscale_peak = consumers_count;
+    pthread_mutex_unlock(&consumers_scale_mutex);
+
+    atomic_store(&autoscaler_running, 1);
+    if (pthread_create(&autoscaler, NULL, autoscaler_processing, NULL) != 0) {
+        atomic_store(&autoscaler_running, 0);
+        printf("Parent: Failure creation of autoscaler thread\n");
+    }
+}
+
+void autoscaler_stop() {
+    if (!atomic_exchange(&autoscaler_running, 0)) return;
+
+    pthread_join(autoscaler, NULL);
+}
+
+double autoscale_average_consumers() {
+    return autoscale_ticks ? (double)autoscale_consumer_ticks / autoscale_ticks : autoscale_peak;
+}
+
+
+// EXIT PROGRAM
+
+void cleanup_and_exit() {
+    printf("\nShutting down...\n");
+
+    autoscaler_stop();
+
+    close_all_threads(1);
+    // after the producers, so nothing schedules into a stopped wheel; before the consumers, so due messages still drain
+    wheel_stop();
+    close_all_threads(-1);
+
+    stats_dump_stop();
+    sync_destroy();
+
+    if (message_queue) {
+        queue_free(message_queue);
+        free(message_queue);
+        message_queue = NULL;
+    }
+
+    pool_print_stats();
+    pool_destroy();
+
+    printf("\nCleanup complete. Exiting...\n");
+}
+
+void termination_handler(int signum) {
+    (void)signum;
+    cleanup_and_exit();
+    log_stop();
+    exit(1);
+}
+
+
+// QUEUE
+
+void resize_queue(int new_max_len) {
+    queue_sync_resize(&queue_sync, new_max_len);
+    log_flush();
+}
+
+// consumers empty slots and free drained segments under queue_mutex, only the lock-free ring reads atomics
+void print_queue() {
+    if (!lock_free_mode) queue_sync_lock(&queue_sync, NULL);
+    queue_print(message_queue);
+    if (!lock_free_mode) queue_sync_unlock(&queue_sync, NULL);
+}
+
+const char* storage_name() {
+    return lock_free_mode ? "lock-free ring" : inline_mode ? "inline ring" : "segmented ring";
+}
+
+void stats_dump_begin() {
+    if (!stats_file) return;
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s, %s", sync_strategy_name(sync_strategy), storage_name());
+    stats_dump_start(stats_file, stats_period_ms, label, MAX_PRODUCER_THREADS);
+}
+
+void message_queue_init() {
+    // aligned so enqueue_pos and dequeue_pos land on separate cache lines
+    message_queue = aligned_alloc(64, sizeof(message_queue_t));
+    if (!message_queue) {
+        perror("Failed to allocate memory for message_queue");
+        exit(EXIT_FAILURE);
+    }
+
+    if (lock_free_mode) {
+        queue_init_lock_free(message_queue, QUEUE_BASE_SIZE);
+    } else if (inline_mode) {
+        queue_init_inline(message_queue, QUEUE_BASE_SIZE);
+    } else {
+        queue_init(message_queue);
+    }
+}
+
+
+// BENCHMARK
+
+void run_benchmark_once(const char* label, bench_summary_t* summary) {
+    message_queue_init();
+    sync_init();
+    stats_reset();
+    stats_dump_begin();
+
+    message_queue->quiet = 1;
+    atomic_store(&green_switches, 0);
+    bench_start();
+
+    for (int i = 0; i < bench_producers; i++) create_thread(1);
+
+    if (autoscale_mode) {
+        autoscaler_start();
+    } else {
+        for (int i = 0; i < bench_consumers; i++) create_thread(-1);
+    }
+
+    sleep(bench_seconds);
+
+    bench_stop();
+    autoscaler_stop();
+    queue_sync_wake_all(&queue_sync);
+    cleanup_and_exit();
+
+    // blocked time is spread over the consumers that were alive on average
+    int consumers = bench_consumers;
+    if (autoscale_mode) {
+        double average = autoscale_average_consumers();
+        consumers = average < 1.0 ? 1 : (int)(average + 0.5);
+    }
+
+    bench_report(label, bench_producers, consumers, MAX_PRODUCER_THREADS, summary);
+
+    affinity_print(bench_producers, autoscale_mode ? autoscale_max : bench_consumers);
+
+    if (delay_max_ms) {
+        wheel_print_stats();
+        printf("\n");
+    }
+
+    if (green_producers || green_consumers) {
+        printf("  green actors: %d producers, %d consumers (0 = plain threads), %d KB stacks, %" PRIu64 " coroutine switches\n",
+            green_producers, green_consumers, CORO_STACK_SIZE / 1024, atomic_load(&green_switches));
+    }
+
+    if (autoscale_mode) {
+        printf("  autoscaler: consumers %d..%d, average %.1f, peak %d, added %d, retired %d\n",
+            autoscale_min, autoscale_max, autoscale_average_consumers(), autoscale_peak, autoscale_added, autoscale_retired);
+    }
+}
+
+// `-s all` runs every strategy and `-A all` every placement in turn with the same queue, batch and load settings,
+// then prints them side by side
+void run_benchmark() {
+    const char* storage = storage_name();
+    char labels[SYNC_STRATEGIES * AFFINITY_POLICIES][64];
+    const char* label_list[SYNC_STRATEGIES * AFFINITY_POLICIES];
+    bench_summary_t summaries[SYNC_STRATEGIES * AFFINITY_POLICIES];
+    affinity_policy_t placement = affinity_policy;
+    int runs = 0;
+
+    for (int i = 0; i < SYNC_STRATEGIES; i++) {
+        if (!bench_all_strategies && i != (int)sync_strategy) continue;
+
+        sync_strategy = (sync_strategy_t)i;
+
+        // an explicit list has nothing to be compared with, `-A all` covers the policies that need no arguments
+        for (int j = 0; j < AFFINITY_POLICIES; j++) {
+            if (bench_all_placements ? j == AFFINITY_LIST : j != (int)placement) continue;
+
+            affinity_policy = (affinity_policy_t)j;
+            affinity_init(affinity_policy);
+
+            if (bench_all_placements || affinity_policy != AFFINITY_NONE) {
+                snprintf(labels[runs], sizeof(labels[runs]), "%s, %s, %s", sync_strategy_name(sync_strategy), storage, affinity_policy_name(affinity_policy));
+            } else {
+                snprintf(labels[runs], sizeof(labels[runs]), "%s, %s", sync_strategy_name(sync_strategy), storage);
+            }
+            label_list[runs] = labels[runs];
+
+            run_benchmark_once(labels[runs], &summaries[runs]);
+            runs++;
+        }
+    }
+
+    if (runs > 1) bench_print_summaries(label_list, summaries, runs);
+}
+
+
+
+void print_usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-s sem|cond|spinpark|spin|all] [-A none|compact|scatter|list:cpus[/cpus]|all] [-l | -i] [-n batch] [-a min:max] [-g green producers:consumers] [-D max delay ms] [-t stats.csv [-T ms]] [-b seconds [-p producers] [-c consumers] [-P producer rate] [-C consumer rate]]\n", name);
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "s:A:lin:a:g:D:t:T:b:p:c:P:C:")) != -1) {
+        switch (opt) {
+            case 's':
+                if (strcmp(optarg, "all") == 0) {
+                    bench_all_strategies = 1;
+                } else if (!sync_strategy_parse(optarg, &sync_strategy)) {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'A':
+                if (strcmp(optarg, "all") == 0) {
+                    bench_all_placements = 1;
+                } else if (!affinity_parse(optarg, &affinity_policy)) {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                lock_free_mode = 1;
+                break;
+            case 'i':
+                inline_mode = 1;
+                break;
+            case 'n':
+                batch_size = atoi(optarg);
+                break;
+            case 'a':
+                autoscale_mode = 1;
+                if (sscanf(optarg, "%d:%d", &autoscale_min, &autoscale_max) != 2) {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'g':
+                if (sscanf(optarg, "%d:%d", &green_producers, &green_consumers) != 2) {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'D':
+                delay_max_ms = atoi(optarg);
+                break;
+            case 't':
+                stats_file = fopen(optarg, "w");
+                if (!stats_file) {
+                    perror("Failed to open stats file");
+                    exit(EXIT_FAILURE);
+                }
+                stats_dump_header(stats_file);
+                break;
+            case 'T':
+                stats_period_ms = atoi(optarg);
+                break;
+            case 'b':
+                bench_mode = 1;
+                bench_seconds = atoi(optarg);
+                break;
+            case 'p':
+                bench_producers = atoi(optarg);
+                break;
+            case 'c':
+                bench_consumers = atoi(optarg);
+                break;
+            case 'P':
+                producer_rate = atoi(optarg);
+                break;
+            case 'C':
+                consumer_rate = atoi(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (lock_free_mode && inline_mode) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (bench_all_strategies && !bench_mode) {
+        fprintf(stderr, "-s all compares strategies and needs -b\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (bench_all_placements && !bench_mode) {
+        fprintf(stderr, "-A all compares placements and needs -b\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (batch_size < 1 || batch_size > MAX_BATCH_SIZE) {
+        fprintf(stderr, "Batch size must be 1..%d\n", MAX_BATCH_SIZE);
+        exit(EXIT_FAILURE);
+    }
+
+    if (autoscale_mode && (autoscale_min < 1 || autoscale_min > autoscale_max || autoscale_max > MAX_CONSUMER_THREADS)) {
+        fprintf(stderr, "Autoscaler needs 1 <= min <= max <= %d consumers\n", MAX_CONSUMER_THREADS);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((green_producers || green_consumers) && (!bench_mode || autoscale_mode)) {
+        fprintf(stderr, "Green actors run in benchmark mode only (-b), without the autoscaler\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (delay_max_ms < 0 || (delay_max_ms && green_producers)) {
+        fprintf(stderr, "Delay can not be negative or used with green producers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // every kernel thread of a green side hosts at least one actor
+    if (green_producers < 0 || green_producers > MAX_GREEN_ACTORS || (green_producers && green_producers < bench_producers)
+        || green_consumers < 0 || green_consumers > MAX_GREEN_ACTORS || (green_consumers && green_consumers < bench_consumers)) {
+        fprintf(stderr, "Green actors must be 0 or between the thread count and %d per side\n", MAX_GREEN_ACTORS);
+        exit(EXIT_FAILURE);
+    }
+
+    if (bench_mode && (bench_seconds <= 0 || bench_producers < 1 || bench_producers > MAX_PRODUCER_THREADS || bench_consumers < 1 || bench_consumers > MAX_CONSUMER_THREADS)) {
+        fprintf(stderr, "Benchmark needs a positive duration and 1..%d producers, 1..%d consumers\n", MAX_PRODUCER_THREADS, MAX_CONSUMER_THREADS);
+        exit(EXIT_FAILURE);
+    }
+
+
+    signal(SIGINT, termination_handler);
+    srand(time(NULL));
+    log_start();
+
+    if (bench_mode) {
+        run_benchmark();
+        log_stop();
+        if (stats_file) fclose(stats_file);
+        return 0;
+    }
+
+    affinity_init(affinity_policy);
+    message_queue_init();
+    sync_init();
+    stats_dump_begin();
+
+    printf("\nEnter option:");
+    printf("\n+ add producer");
+    printf("\n- remove last added producer");
+    printf("\n* add consumer");
+    printf("\n_ remove last added consumer");
+    printf("\nl print queue");
+    printf("\ns print childs");
+    printf("\ne expand queue (len + 1)");
+    printf("\nr reduce queue (len - 1)");
+    printf("\nc <len> resize queue to len");
+    printf("\nm print message pool stats");
+    printf("\nt print per-thread stats");
+    printf("\nw print timer wheel stats");
+    printf("\nq quit");
+    printf("\n(wait strategy: %s)", sync_strategy_name(sync_strategy));
+    if (affinity_policy != AFFINITY_NONE) printf("\n(thread placement: %s)", affinity_policy_name(affinity_policy));
+    if (delay_max_ms) printf("\n(messages are delivered after a random delay of up to %d ms)", delay_max_ms);
+    if (lock_free_mode) printf("\n(lock-free queue, capacity %d)", message_queue->max_len);
+    if (inline_mode) printf("\n(inline queue, capacity %d)", message_queue->max_len);
+    if (autoscale_mode) {
+        printf("\n(autoscaling consumers between %d and %d)", autoscale_min, autoscale_max);
+        autoscaler_start();
+    }
+
+    while (1) {
+        char option[10];
+
+        printf("\nOPtion: ");
+        if (scanf("%9s", option) != 1) {
+            continue;
+        }
+
+        if (strcmp(option, "+") == 0) {
+            create_thread(1);
+        } else if (strcmp(option, "*") == 0) {
+            pthread_mutex_lock(&consumers_scale_mutex);
+            create_thread(-1);
+            pthread_mutex_unlock(&consumers_scale_mutex);
+        } else if (strcmp(option, "-") == 0) {
+            close_thread_by_ind(producers_count - 1, 1);
+        } else if (strcmp(option, "_") == 0) {
+            pthread_mutex_lock(&consumers_scale_mutex);
+            close_thread_by_ind(consumers_count - 1, -1);
+            pthread_mutex_unlock(&consumers_scale_mutex);
+        } else if (strcmp(option, "l") == 0) {
+            print_queue();
+        } else if (strcmp(option, "m") == 0) {
+            pool_print_stats();
+        } else if (strcmp(option, "t") == 0) {
+            stats_print(MAX_PRODUCER_THREADS);
+        } else if (strcmp(option, "w") == 0) {
+            if (delay_max_ms) {
+                wheel_print_stats();
+            } else {
+                printf("\nParent: delayed delivery is off, start with -D");
+            }
+        } else if (strcmp(option, "s") == 0) {
+            printf("\nParent: Now %d producer threads, %d consumer threads", producers_count, consumers_count);
+        } else if (strcmp(option, "r") == 0) {
+            resize_queue(message_queue->max_len - 1);
+        } else if (strcmp(option, "e") == 0) {
+            resize_queue(message_queue->max_len + 1);
+        } else if (strcmp(option, "c") == 0) {
+            int new_max_len;
+            if (scanf("%d", &new_max_len) != 1) {
+                printf("\nParent: expected new queue len");
+                continue;
+            }
+
+            resize_queue(new_max_len);
+        } else if (strcmp(option, "q") == 0) {
+            cleanup_and_exit();
+            log_stop();
+            if (stats_file) fclose(stats_file);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+
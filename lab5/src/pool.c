@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "./headers/pool.h"
+
+typedef struct pool_magazine {
+    struct pool_magazine* next;
+    struct pool_magazine* next_created;
+    int count;
+    message_queue_element_t* elements[POOL_MAGAZINE_SIZE];
+} pool_magazine_t;
+
+typedef struct pool_slab {
+    struct pool_slab* next;
+    message_queue_element_t elements[POOL_SLAB_ELEMENTS];
+} pool_slab_t;
+
+// DEPOT (guarded by depot_mutex)
+
+static pthread_mutex_t depot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pool_magazine_t* full_magazines = NULL;
+static pool_magazine_t* empty_magazines = NULL;
+static pool_magazine_t* created_magazines = NULL;
+
+static pool_slab_t* slabs = NULL;
+static int slab_used = POOL_SLAB_ELEMENTS;
+
+static pool_stats_t depot_stats = {0};
+
+// PER-THREAD MAGAZINES
+
+static _Thread_local pool_magazine_t* loaded = NULL;
+static _Thread_local pool_magazine_t* previous = NULL;
+
+static _Thread_local uint64_t local_allocs = 0;
+static _Thread_local uint64_t local_frees = 0;
+static _Thread_local uint64_t local_hits = 0;
+
+
+static void fold_local_stats() {
+    depot_stats.allocs += local_allocs;
+    depot_stats.frees += local_frees;
+    depot_stats.magazine_hits += local_hits;
+
+    local_allocs = 0;
+    local_frees = 0;
+    local_hits = 0;
+}
+
+static void push_magazine(pool_magazine_t** list, pool_magazine_t* magazine) {
+    magazine->next = *list;
+    *list = magazine;
+
+    if (list == &full_magazines) depot_stats.full_magazines++;
+}
+
+static pool_magazine_t* pop_magazine(pool_magazine_t** list) {
+    pool_magazine_t* magazine = *list;
+    if (!magazine) return NULL;
+
+    *list = magazine->next;
+    if (list == &full_magazines) depot_stats.full_magazines--;
+
+    return magazine;
+}
+
+static pool_magazine_t* take_empty_magazine() {
+    pool_magazine_t* magazine = pop_magazine(&empty_magazines);
+    if (magazine) return magazine;
+
+    magazine = malloc(sizeof(pool_magazine_t));
+    if (!magazine) {
+        perror("Pool: failed to allocate magazine");
+        exit(EXIT_FAILURE);
+    }
+
+    magazine->count = 0;
+    magazine->next_created = created_magazines;
+    created_magazines = magazine;
+
+    return magazine;
+}
+
+static void carve_slab(pool_magazine_t* magazine) {
+    while (magazine->count < POOL_MAGAZINE_SIZE) {
+        if (slab_used == POOL_SLAB_ELEMENTS) {
+            pool_slab_t* slab = malloc(sizeof(pool_slab_t));
+            if (!slab) {
+                perror("Pool: failed to allocate slab");
+                exit(EXIT_FAILURE);
+            }
+
+            slab->next = slabs;
+            slabs = slab;
+            slab_used = 0;
+            depot_stats.slabs++;
+        }
+
+        magazine->elements[magazine->count++] = &slabs->elements[slab_used++];
+    }
+}
+
+static void swap_magazines() {
+    pool_magazine_t* magazine = loaded;
+    loaded = previous;
+    previous = magazine;
+}
+
+
+// ALLOC/FREE
+
+message_queue_element_t* pool_alloc() {
+    local_allocs++;
+
+    if (loaded && loaded->count > 0) {
+        local_hits++;
+        return loaded->elements[--loaded->count];
+    }
+
+    if (previous && previous->count > 0) {
+        swap_magazines();
+        local_hits++;
+        return loaded->elements[--loaded->count];
+    }
+
+    pthread_mutex_lock(&depot_mutex);
+    fold_local_stats();
+    depot_stats.depot_exchanges++;
+
+    // both magazines are empty here: the older one goes back, the loaded one becomes previous
+    if (previous) push_magazine(&empty_magazines, previous);
+    previous = loaded;
+
+    loaded = pop_magazine(&full_magazines);
+    if (!loaded) {
+        loaded = take_empty_magazine();
+        carve_slab(loaded);
+    }
+    pthread_mutex_unlock(&depot_mutex);
+
+    return loaded->elements[--loaded->count];
+}
+
+void pool_free(message_queue_element_t* element) {
+    if (!element) return;
+
+    local_frees++;
+
+    if (loaded && loaded->count < POOL_MAGAZINE_SIZE) {
+        local_hits++;
+        loaded->elements[loaded->count++] = element;
+        return;
+    }
+
+    if (previous && previous->count < POOL_MAGAZINE_SIZE) {
+        swap_magazines();
+        local_hits++;
+        loaded->elements[loaded->count++] = element;
+        return;
+    }
+
+    // a consumer filling up magazines hands them back whole, so producers on other threads pick them up from the depot
+    pthread_mutex_lock(&depot_mutex);
+    fold_local_stats();
+    depot_stats.depot_exchanges++;
+
+    if (previous) push_magazine(&full_magazines, previous);
+    previous = loaded;
+    loaded = take_empty_magazine();
+    pthread_mutex_unlock(&depot_mutex);
+
+    loaded->elements[loaded->count++] = element;
+}
+
+void pool_thread_flush() {
+    pthread_mutex_lock(&depot_mutex);
+    fold_local_stats();
+
+    pool_magazine_t* magazines[2] = {loaded, previous};
+    for (int i = 0; i < 2; i++) {
+        if (!magazines[i]) continue;
+
+        push_magazine(magazines[i]->count > 0 ? &full_magazines : &empty_magazines, magazines[i]);
+    }
+
+    loaded = NULL;
+    previous = NULL;
+    pthread_mutex_unlock(&depot_mutex);
+}
+
+
+// STATS
+
+void pool_get_stats(pool_stats_t* stats) {
+    pthread_mutex_lock(&depot_mutex);
+    fold_local_stats();
+    *stats = depot_stats;
+    pthread_mutex_unlock(&depot_mutex);
+}
+
+void pool_print_stats() {
+    pool_stats_t stats;
+    pool_get_stats(&stats);
+
+    uint64_t ops = stats.allocs + stats.frees;
+
+    printf("\nPool: slab statistics (counters of running threads are folded in at their last depot exchange)");
+    printf("\n  (slabs %" PRIu64 " ; elements %" PRIu64 " ; in use %" PRId64 ")", stats.slabs, stats.slabs * POOL_SLAB_ELEMENTS, (int64_t)(stats.allocs - stats.frees));
+    printf("\n  (allocs %" PRIu64 " ; frees %" PRIu64 " ; magazine hits %.1f%% ; depot exchanges %" PRIu64 " ; full magazines in depot %" PRIu64 ")",
+        stats.allocs, stats.frees, ops ? 100.0 * stats.magazine_hits / ops : 0.0, stats.depot_exchanges, stats.full_magazines);
+    printf("\n\t");
+}
+
+void pool_destroy() {
+    pthread_mutex_lock(&depot_mutex);
+
+    while (created_magazines) {
+        pool_magazine_t* magazine = created_magazines;
+        created_magazines = magazine->next_created;
+        free(magazine);
+    }
+
+    while (slabs) {
+        pool_slab_t* slab = slabs;
+        slabs = slab->next;
+        free(slab);
+    }
+
+    full_magazines = NULL;
+    empty_magazines = NULL;
+    slab_used = POOL_SLAB_ELEMENTS;
+    loaded = NULL;
+    previous = NULL;
+
+    pthread_mutex_unlock(&depot_mutex);
+}
@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include "./headers/queue.h"
+#include "./headers/pool.h"
+#include "./headers/log.h"
+
+void queue_init(message_queue_t* queue) {
+    if (!queue) return;
+
+    queue->head = 0;
+    queue->tail = 0;
+    queue->len = 0;
+    queue->max_len = QUEUE_BASE_SIZE;
+    queue->quiet = 0;
+    queue->lock_free = 0;
+    queue->cells = NULL;
+    queue->inline_storage = 0;
+    queue->slots = NULL;
+
+    queue->head_segment = calloc(1, sizeof(queue_segment_t));
+    queue->tail_segment = queue->head_segment;
+    queue->spare_segment = NULL;
+}
+
+void queue_init_lock_free(message_queue_t* queue, int capacity) {
+    if (!queue) return;
+
+    int size = 1;
+    while (size < capacity) size <<= 1;
+
+    queue->head = 0;
+    queue->tail = 0;
+    queue->len = 0;
+    queue->max_len = size;
+    queue->quiet = 0;
+    queue->head_segment = NULL;
+    queue->tail_segment = NULL;
+    queue->spare_segment = NULL;
+
+    queue->inline_storage = 0;
+    queue->slots = NULL;
+
+    queue->lock_free = 1;
+    queue->mask = size - 1;
+    queue->cells = malloc(sizeof(queue_cell_t) * size);
+    for (int i = 0; i < size; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+        queue->cells[i].message = NULL;
+    }
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+}
+
+void queue_init_inline(message_queue_t* queue, int capacity) {
+    if (!queue) return;
+
+    queue->head = 0;
+    queue->tail = 0;
+    queue->len = 0;
+    queue->max_len = capacity;
+    queue->quiet = 0;
+    queue->lock_free = 0;
+    queue->cells = NULL;
+    queue->head_segment = NULL;
+    queue->tail_segment = NULL;
+    queue->spare_segment = NULL;
+
+    // aligned_alloc wants a multiple of the alignment
+    size_t bytes = sizeof(message_queue_element_t) * capacity;
+    bytes = (bytes + 63) & ~(size_t)63;
+
+    queue->inline_storage = 1;
+    queue->slots = aligned_alloc(64, bytes);
+    if (!queue->slots) {
+        perror("Queue: failed to allocate inline slots");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int queue_resize(message_queue_t* queue, int new_max_len) {
+    if (!queue) {
+        log_printf("\nQueue: queue is null");
+        return 0;
+    }
+
+    if (queue->lock_free) {
+        log_printf("\nQueue: lock-free queue has a fixed capacity");
+        return 0;
+    }
+
+    if (queue->inline_storage) {
+        log_printf("\nQueue: inline queue has a fixed capacity");
+        return 0;
+    }
+
+    if (new_max_len < 1) {
+        log_printf("\nQueue: cannot resize queue, max len must be at least 1");
+        return 0;
+    }
+
+    // live elements above a smaller bound stay queued, producers just see a full queue until they drain
+    queue->max_len = new_max_len;
+    return 1;
+}
+
+void queue_expand(message_queue_t* queue) {
+    if (!queue) {
+        log_printf("\nQueue: queue is null");
+        return;
+    }
+
+    queue_resize(queue, queue->max_len + 1);
+}
+
+void queue_reduce(message_queue_t* queue) {
+    if (!queue) {
+        log_printf("\nQueue: queue is null");
+        return;
+    }
+
+    queue_resize(queue, queue->max_len - 1);
+}
+
+void queue_free(message_queue_t* queue) {
+    if (!queue) return;
+
+    if (queue->lock_free) {
+        message_queue_element_t* message;
+        while ((message = queue_pop(queue)) != NULL) {
+            pool_free(message);
+        }
+
+        free(queue->cells);
+        queue->cells = NULL;
+        return;
+    }
+
+    if (queue->inline_storage) {
+        free(queue->slots);
+        queue->slots = NULL;
+        queue->len = 0;
+        return;
+    }
+
+    if (!queue->head_segment) return;
+
+    while (queue->len > 0) {
+        pool_free(queue_pop(queue));
+    }
+
+    free(queue->head_segment);
+    free(queue->spare_segment);
+    queue->head_segment = NULL;
+    queue->tail_segment = NULL;
+    queue->spare_segment = NULL;
+}
+
+
+// Vyukov's bounded MPMC queue: a cell is free for position pos when its sequence equals pos,
+// and holds a message for position pos when its sequence equals pos + 1
+static int queue_push_lock_free(message_queue_element_t* new_message, message_queue_t* queue) {
+    queue_cell_t* cell;
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1, memory_order_seq_cst, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->message = new_message;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 1;
+}
+
+static message_queue_element_t* queue_pop_lock_free(message_queue_t* queue) {
+    queue_cell_t* cell;
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1, memory_order_seq_cst, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    message_queue_element_t* data = cell->message;
+    cell->message = NULL;
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+    return data;
+}
+
+// SEGMENTED AND INLINE RING STEPS (callers check len against max_len)
+
+static void segment_append(message_queue_t* queue, message_queue_element_t* new_message) {
+    if (queue->tail == QUEUE_SEGMENT_SIZE) {
+        queue_segment_t* segment = queue->spare_segment;
+        if (segment) {
+            queue->spare_segment = NULL;
+        } else {
+            segment = malloc(sizeof(queue_segment_t));
+        }
+
+        segment->next = NULL;
+        queue->tail_segment->next = segment;
+        queue->tail_segment = segment;
+        queue->tail = 0;
+    }
+
+    queue->tail_segment->messages[queue->tail++] = new_message;
+    queue->len++;
+}
+
+static message_queue_element_t* segment_take(message_queue_t* queue) {
+    message_queue_element_t* data = queue->head_segment->messages[queue->head];
+
+    queue->head_segment->messages[queue->head++] = NULL;
+    queue->len--;
+
+    if (queue->len == 0) {
+        queue->head = 0;
+        queue->tail = 0;
+    } else if (queue->head == QUEUE_SEGMENT_SIZE) {
+        // keep one drained segment around so a steady push/pop stream does not hit malloc
+        queue_segment_t* drained = queue->head_segment;
+        queue->head_segment = drained->next;
+        queue->head = 0;
+
+        if (queue->spare_segment) {
+            free(drained);
+        } else {
+            queue->spare_segment = drained;
+        }
+    }
+
+    return data;
+}
+
+// only the used part of data is copied
+static size_t message_bytes(const message_queue_element_t* message) {
+    return offsetof(message_queue_element_t, data) + sizeof(message->data[0]) * message->size;
+}
+
+static void slot_append(message_queue_t* queue, const message_queue_element_t* message) {
+    memcpy(&queue->slots[queue->tail], message, message_bytes(message));
+    queue->tail = (queue->tail + 1) % queue->max_len;
+    queue->len++;
+}
+
+static void slot_take(message_queue_t* queue, message_queue_element_t* message) {
+    memcpy(message, &queue->slots[queue->head], message_bytes(&queue->slots[queue->head]));
+    queue->head = (queue->head + 1) % queue->max_len;
+    queue->len--;
+}
+
+int queue_push(message_queue_element_t* new_message, message_queue_t* queue) {
+    if (!queue || !new_message) {
+        log_printf("Queue: queue or new message is null");
+        return 0;
+    }    
+
+    if (queue->lock_free) {
+        return queue_push_lock_free(new_message, queue);
+    }
+
+    if (queue->inline_storage) {
+        log_printf("\nQueue: inline queue only takes copies");
+        return 0;
+    }
+
+    if (queue->len >= queue->max_len) return 0;
+
+    segment_append(queue, new_message);
+    return 1;
+}
+
+message_queue_element_t* queue_pop(message_queue_t* queue) {
+    if (!queue) {
+        log_printf("\nQueue: queue ptr is null");
+        exit(1);
+    };
+
+    if (queue->lock_free) {
+        return queue_pop_lock_free(queue);
+    }
+
+    if (queue->inline_storage) {
+        log_printf("\nQueue: inline queue only hands out copies");
+        return NULL;
+    }
+
+    if (queue->len == 0) return NULL;
+
+    return segment_take(queue);
+}
+
+int queue_push_copy(const message_queue_element_t* message, message_queue_t* queue) {
+    if (!queue || !message) {
+        log_printf("Queue: queue or new message is null");
+        return 0;
+    }
+
+    if (!queue->inline_storage) {
+        message_queue_element_t* copy = pool_alloc();
+        memcpy(copy, message, message_bytes(message));
+
+        if (!queue_push(copy, queue)) {
+            pool_free(copy);
+            return 0;
+        }
+
+        return 1;
+    }
+
+    if (queue->len >= queue->max_len) return 0;
+
+    slot_append(queue, message);
+    return 1;
+}
+
+int queue_pop_copy(message_queue_element_t* message, message_queue_t* queue) {
+    if (!queue || !message) {
+        log_printf("\nQueue: queue or message buffer is null");
+        return 0;
+    }
+
+    if (!queue->inline_storage) {
+        message_queue_element_t* data = queue_pop(queue);
+        if (!data) return 0;
+
+        memcpy(message, data, message_bytes(data));
+        pool_free(data);
+        return 1;
+    }
+
+    if (queue->len == 0) return 0;
+
+    slot_take(queue, message);
+
+    return 1;
+}
+
+// batch versions move up to n messages and return how many moved, so callers pay one lock acquisition per batch;
+// for the inline ring the pointers are caller buffers that messages are copied from or into
+int queue_push_n(message_queue_element_t** messages, int n, message_queue_t* queue) {
+    if (!queue || !messages) {
+        log_printf("Queue: queue or new messages are null");
+        return 0;
+    }
+
+    int pushed = 0;
+
+    if (queue->lock_free) {
+        while (pushed < n && queue_push_lock_free(messages[pushed], queue)) pushed++;
+        return pushed;
+    }
+
+    int room = queue->max_len - queue->len;
+    if (n > room) n = room;
+
+    for (; pushed < n; pushed++) {
+        if (queue->inline_storage) {
+            slot_append(queue, messages[pushed]);
+        } else {
+            segment_append(queue, messages[pushed]);
+        }
+    }
+    return pushed;
+}
+
+int queue_pop_n(message_queue_element_t** messages, int n, message_queue_t* queue) {
+    if (!queue || !messages) {
+        log_printf("\nQueue: queue or message buffers are null");
+        return 0;
+    }
+
+    int popped = 0;
+
+    if (queue->lock_free) {
+        while (popped < n && (messages[popped] = queue_pop_lock_free(queue)) != NULL) popped++;
+        return popped;
+    }
+
+    if (n > queue->len) n = queue->len;
+
+    for (; popped < n; popped++) {
+        if (queue->inline_storage) {
+            slot_take(queue, messages[popped]);
+        } else {
+            messages[popped] = segment_take(queue);
+        }
+    }
+
+    return popped;
+}
+
+message_queue_element_t* queue_generate_message() {
+    message_queue_element_t* message = pool_alloc();
+    queue_fill_message(message);
+
+    return message;
+}
+
+// rand() takes a process-wide lock on every call, so each thread draws from its own rand_r state seeded once from rand()
+static _Thread_local unsigned int fill_seed = 0;
+
+void queue_fill_message(message_queue_element_t* message) {
+    if (fill_seed == 0) fill_seed = (unsigned int)rand() | 1;
+
+    message->size = rand_r(&fill_seed) % 20 + 1;
+    message->type = 1;
+    message->hash = 0;
+    message->send_time = 0;
+
+    for (int i = 0; i < message->size; i++) {
+        message->data[i] = rand_r(&fill_seed) % 9 + 1;
+    }
+}
+
+void queue_print(message_queue_t* queue) {
+    if (!queue) return;
+
+    if (queue->lock_free) {
+        size_t enqueue_pos = atomic_load(&queue->enqueue_pos);
+        size_t dequeue_pos = atomic_load(&queue->dequeue_pos);
+
+        printf("\nQueue: current state of lock-free queue: ");
+        printf("\n  (max len %d ; current len %zu ; dequeue position %zu ; enqueue position %zu)", queue->max_len, enqueue_pos - dequeue_pos, dequeue_pos, enqueue_pos);
+        printf("\n\t");
+        return;
+    }
+
+    printf("\nQueue: current state of queue: ");
+    printf("\n  (max len %d ; current len %d ; head position %d ; tail position %d)", queue->max_len, queue->len, queue->head, queue->tail);
+
+    if (queue->inline_storage) {
+        for (int i = 0; i < queue->len; i++) {
+            message_queue_element_t* message = &queue->slots[(queue->head + i) % queue->max_len];
+            printf("\n\t");
+            for (int j = 0; j < message->size; j++) {
+                printf("%d", message->data[j]);
+            }
+        }
+
+        printf("\n\t");
+        return;
+    }
+
+    queue_segment_t* segment = queue->head_segment;
+    int slot = queue->head;
+    for (int i = 0; i < queue->len; i++) {
+        if (slot == QUEUE_SEGMENT_SIZE) {
+            segment = segment->next;
+            slot = 0;
+        }
+
+        message_queue_element_t* message = segment->messages[slot++];
+        printf("\n\t");
+        for (int j = 0; j < message->size; j++) {
+            printf("%d", message->data[j]);
+        }
+    }
+
+    printf("\n\t");
+}
+
+
+int queue_len(message_queue_t* queue) {
+    if (queue->lock_free) {
+        size_t dequeue_pos = atomic_load(&queue->dequeue_pos);
+        size_t enqueue_pos = atomic_load(&queue->enqueue_pos);
+        return enqueue_pos > dequeue_pos ? (int)(enqueue_pos - dequeue_pos) : 0;
+    }
+
+    return queue->len;
+}
+
+int queue_is_full(message_queue_t* queue) {
+    if (queue->lock_free) {
+        return atomic_load(&queue->enqueue_pos) - atomic_load(&queue->dequeue_pos) >= (size_t)queue->max_len;
+    }
+
+    return queue->len >= queue->max_len;
+}
+
+int queue_is_empty(message_queue_t* queue) {
+    if (queue->lock_free) {
+        return atomic_load(&queue->enqueue_pos) == atomic_load(&queue->dequeue_pos);
+    }
+
+    return queue->len == 0;
+}
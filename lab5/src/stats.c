@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "./headers/stats.h"
+#include "./headers/bench.h"
+
+static thread_stats_t slots[STATS_MAX_SLOTS];
+
+// CSV DUMP (state of the dump thread)
+
+static atomic_int dump_running = 0;
+static pthread_t dump_thread;
+static FILE* dump_file = NULL;
+static int dump_period_ms = STATS_DUMP_PERIOD_MS;
+static int dump_producer_slots = 0;
+static char dump_label[64];
+static uint64_t dump_start_ns = 0;
+
+
+thread_stats_t* stats_slot(int slot) {
+    if (slot < 0 || slot >= STATS_MAX_SLOTS) return NULL;
+
+    return &slots[slot];
+}
+
+// every slot has a single writer, so a relaxed load and store is enough and no locked instruction is paid
+void stats_add(_Atomic uint64_t* counter, uint64_t value) {
+    uint64_t current = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, current + value, memory_order_relaxed);
+}
+
+// only while no thread owns a slot
+void stats_reset() {
+    for (int i = 0; i < STATS_MAX_SLOTS; i++) {
+        atomic_store(&slots[i].pushes, 0);
+        atomic_store(&slots[i].pops, 0);
+        atomic_store(&slots[i].free_space_wait_ns, 0);
+        atomic_store(&slots[i].items_wait_ns, 0);
+        atomic_store(&slots[i].lock_wait_ns, 0);
+        atomic_store(&slots[i].lock_hold_ns, 0);
+    }
+}
+
+// each counter is read on its own, a running thread may be one update ahead in some of them
+void stats_snapshot(stats_snapshot_t* snapshot) {
+    for (int i = 0; i < STATS_MAX_SLOTS; i++) {
+        stats_values_t* values = &snapshot->slots[i];
+
+        values->pushes = atomic_load_explicit(&slots[i].pushes, memory_order_relaxed);
+        values->pops = atomic_load_explicit(&slots[i].pops, memory_order_relaxed);
+        values->free_space_wait_ns = atomic_load_explicit(&slots[i].free_space_wait_ns, memory_order_relaxed);
+        values->items_wait_ns = atomic_load_explicit(&slots[i].items_wait_ns, memory_order_relaxed);
+        values->lock_wait_ns = atomic_load_explicit(&slots[i].lock_wait_ns, memory_order_relaxed);
+        values->lock_hold_ns = atomic_load_explicit(&slots[i].lock_hold_ns, memory_order_relaxed);
+    }
+}
+
+void stats_sum(const stats_snapshot_t* snapshot, int from, int to, stats_values_t* total) {
+    memset(total, 0, sizeof(*total));
+
+    for (int i = from; i < to && i < STATS_MAX_SLOTS; i++) {
+        const stats_values_t* values = &snapshot->slots[i];
+
+        total->pushes += values->pushes;
+        total->pops += values->pops;
+        total->free_space_wait_ns += values->free_space_wait_ns;
+        total->items_wait_ns += values->items_wait_ns;
+        total->lock_wait_ns += values->lock_wait_ns;
+        total->lock_hold_ns += values->lock_hold_ns;
+    }
+}
+
+static int is_used(const stats_values_t* values) {
+    return values->pushes || values->pops || values->free_space_wait_ns || values->items_wait_ns || values->lock_wait_ns || values->lock_hold_ns;
+}
+
+static void slot_name(int slot, int producer_slots, char* name, size_t size) {
+    if (slot < producer_slots) {
+        snprintf(name, size, "producer %d", slot);
+    } else {
+        snprintf(name, size, "consumer %d", slot - producer_slots);
+    }
+}
+
+
+// PRINT
+
+static void print_values(const char* name, const stats_values_t* values) {
+    printf("\n  %-12s %10" PRIu64 " %10" PRIu64 " %14.1f %14.1f %13.1f %13.1f",
+        name, values->pushes, values->pops,
+        values->free_space_wait_ns / 1e6, values->items_wait_ns / 1e6,
+        values->lock_wait_ns / 1e6, values->lock_hold_ns / 1e6);
+}
+
+void stats_print(int producer_slots) {
+    stats_snapshot_t snapshot;
+    stats_snapshot(&snapshot);
+
+    printf("\nStats: per-thread counters since start (slots are kept when a thread closes)");
+    printf("\n  %-12s %10s %10s %14s %14s %13s %13s", "thread", "pushes", "pops", "free wait ms", "items wait ms", "lock wait ms", "lock hold ms");
+
+    for (int i = 0; i < STATS_MAX_SLOTS; i++) {
+        if (!is_used(&snapshot.slots[i])) continue;
+
+        char name[32];
+        slot_name(i, producer_slots, name, sizeof(name));
+        print_values(name, &snapshot.slots[i]);
+    }
+
+    stats_values_t total;
+    stats_sum(&snapshot, 0, producer_slots, &total);
+    print_values("producers", &total);
+    stats_sum(&snapshot, producer_slots, STATS_MAX_SLOTS, &total);
+    print_values("consumers", &total);
+    printf("\n\t");
+}
+
+
+// CSV DUMP
+
+void stats_dump_header(FILE* file) {
+    fprintf(file, "run,time_ms,thread,pushes,pops,free_space_wait_ns,items_wait_ns,lock_wait_ns,lock_hold_ns\n");
+    fflush(file);
+}
+
+static void dump_row(uint64_t time_ms, const char* name, const stats_values_t* values) {
+    fprintf(dump_file, "\"%s\",%" PRIu64 ",%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+        dump_label, time_ms, name, values->pushes, values->pops,
+        values->free_space_wait_ns, values->items_wait_ns, values->lock_wait_ns, values->lock_hold_ns);
+}
+
+static void dump_snapshot(uint64_t time_ms) {
+    stats_snapshot_t snapshot;
+    stats_snapshot(&snapshot);
+
+    for (int i = 0; i < STATS_MAX_SLOTS; i++) {
+        if (!is_used(&snapshot.slots[i])) continue;
+
+        char name[32];
+        slot_name(i, dump_producer_slots, name, sizeof(name));
+        dump_row(time_ms, name, &snapshot.slots[i]);
+    }
+
+    stats_values_t total;
+    stats_sum(&snapshot, 0, dump_producer_slots, &total);
+    dump_row(time_ms, "producers", &total);
+    stats_sum(&snapshot, dump_producer_slots, STATS_MAX_SLOTS, &total);
+    dump_row(time_ms, "consumers", &total);
+
+    fflush(dump_file);
+}
+
+static void* dump_processing(void* arg) {
+    (void)arg;
+
+    struct timespec period = {dump_period_ms / 1000, (dump_period_ms % 1000) * 1000000L};
+
+    while (atomic_load(&dump_running)) {
+        nanosleep(&period, NULL);
+        dump_snapshot((bench_now_ns() - dump_start_ns) / 1000000);
+    }
+
+    return NULL;
+}
+
+void stats_dump_start(FILE* file, int period_ms, const char* label, int producer_slots) {
+    dump_file = file;
+    dump_period_ms = period_ms > 0 ? period_ms : STATS_DUMP_PERIOD_MS;
+    dump_producer_slots = producer_slots;
+    snprintf(dump_label, sizeof(dump_label), "%s", label);
+    dump_start_ns = bench_now_ns();
+
+    atomic_store(&dump_running, 1);
+    if (pthread_create(&dump_thread, NULL, dump_processing, NULL) != 0) {
+        atomic_store(&dump_running, 0);
+        printf("\nStats: failed to start the CSV dump thread");
+    }
+}
+
+void stats_dump_stop() {
+    if (!atomic_exchange(&dump_running, 0)) return;
+
+    pthread_join(dump_thread, NULL);
+
+    // the last row holds the final counters, closed threads included
+    dump_snapshot((bench_now_ns() - dump_start_ns) / 1000000);
+}
@@ -0,0 +1,559 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include "./headers/sync.h"
+#include "./headers/log.h"
+
+static const char* strategy_options[SYNC_STRATEGIES] = {"sem", "cond", "spinpark", "spin"};
+static const char* strategy_names[SYNC_STRATEGIES] = {"semaphores", "condvars", "spin-then-park", "spin"};
+
+
+const char* sync_strategy_name(sync_strategy_t strategy) {
+    if (strategy < 0 || strategy >= SYNC_STRATEGIES) return "unknown";
+
+    return strategy_names[strategy];
+}
+
+int sync_strategy_parse(const char* name, sync_strategy_t* strategy) {
+    for (int i = 0; i < SYNC_STRATEGIES; i++) {
+        if (strcmp(name, strategy_options[i]) == 0) {
+            *strategy = (sync_strategy_t)i;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int sync_no_wait(int ind) {
+    (void)ind;
+    return 1;
+}
+
+
+// INIT AND END
+
+void queue_sync_init(queue_sync_t* sync, message_queue_t* queue, sync_strategy_t strategy) {
+    sync->strategy = strategy;
+    sync->queue = queue;
+    sync->shrink_debt = 0;
+    atomic_init(&sync->producers_waiting, 0);
+    atomic_init(&sync->consumers_waiting, 0);
+
+    if (
+        sem_init(&sync->free_space_sem, 0, queue->max_len) != 0
+        || sem_init(&sync->items_sem, 0, 0) != 0
+        || pthread_cond_init(&sync->free_space_cond, NULL) != 0
+        || pthread_cond_init(&sync->items_cond, NULL) != 0
+        || pthread_mutex_init(&sync->queue_mutex, NULL) != 0
+    ) {
+        perror("Queue: semaphores/conds/mutex creation failed");
+        exit(1);
+    }
+}
+
+void queue_sync_destroy(queue_sync_t* sync) {
+    sem_destroy(&sync->free_space_sem);
+    sem_destroy(&sync->items_sem);
+    pthread_cond_destroy(&sync->free_space_cond);
+    pthread_cond_destroy(&sync->items_cond);
+    pthread_mutex_destroy(&sync->queue_mutex);
+}
+
+
+// THREAD STATS
+
+// when the calling thread took queue_mutex, for its lock hold time
+static _Thread_local uint64_t lock_acquired_ns = 0;
+
+static uint64_t wait_started(uint64_t start) {
+    return start ? start : bench_now_ns();
+}
+
+static void count_wait(_Atomic uint64_t* counter, uint64_t start) {
+    if (counter && start) stats_add(counter, bench_now_ns() - start);
+}
+
+static _Atomic uint64_t* free_space_wait(thread_stats_t* stats) {
+    return stats ? &stats->free_space_wait_ns : NULL;
+}
+
+static _Atomic uint64_t* items_wait(thread_stats_t* stats) {
+    return stats ? &stats->items_wait_ns : NULL;
+}
+
+static void stamp_messages(message_queue_element_t** messages, int n) {
+    uint64_t now = bench_now_ns();
+    for (int i = 0; i < n; i++) {
+        messages[i]->send_time = now;
+    }
+}
+
+void queue_sync_lock(queue_sync_t* sync, thread_stats_t* stats) {
+    if (pthread_mutex_trylock(&sync->queue_mutex) != 0) {
+        uint64_t start = bench_now_ns();
+        pthread_mutex_lock(&sync->queue_mutex);
+        if (stats) stats_add(&stats->lock_wait_ns, bench_now_ns() - start);
+    }
+
+    if (stats) lock_acquired_ns = bench_now_ns();
+}
+
+void queue_sync_unlock(queue_sync_t* sync, thread_stats_t* stats) {
+    if (stats) stats_add(&stats->lock_hold_ns, bench_now_ns() - lock_acquired_ns);
+    pthread_mutex_unlock(&sync->queue_mutex);
+}
+
+// time parked on a cond is waiting, not holding queue_mutex
+static void cond_wait(queue_sync_t* sync, pthread_cond_t* cond, thread_stats_t* stats) {
+    if (stats) stats_add(&stats->lock_hold_ns, bench_now_ns() - lock_acquired_ns);
+    pthread_cond_wait(cond, &sync->queue_mutex);
+    if (stats) lock_acquired_ns = bench_now_ns();
+}
+
+static void spin_pause(int spins) {
+    if (spins % SYNC_SPIN_YIELD == SYNC_SPIN_YIELD - 1) {
+        sched_yield();
+        return;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// re-checks while spinning are left out of the lock times, two clock reads would cost more than the check;
+// the hold time restarts once the wait is over
+static void spin_relock(queue_sync_t* sync, int spins) {
+    pthread_mutex_unlock(&sync->queue_mutex);
+    spin_pause(spins);
+    pthread_mutex_lock(&sync->queue_mutex);
+}
+
+static int spin_limit(queue_sync_t* sync) {
+    if (sync->strategy == SYNC_SPIN) return INT_MAX;
+    if (sync->strategy == SYNC_SPIN_PARK) return SYNC_SPIN_LIMIT;
+
+    return 0;
+}
+
+
+// SEMAPHORES
+
+// semaphores can not be broadcast to, so a blocked thread polls its stop condition instead of being cancelled
+static int sem_wait_or_stop(sem_t* sem, sync_stop_t stop, int ind, _Atomic uint64_t* wait_counter) {
+    if (sem_trywait(sem) == 0) return 1;
+    if (stop(ind)) return 0;
+
+    uint64_t start = wait_started(0);
+
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += SYNC_STOP_POLL_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        if (sem_timedwait(sem, &deadline) == 0) break;
+
+        if (stop(ind)) {
+            count_wait(wait_counter, start);
+            return 0;
+        }
+    }
+
+    count_wait(wait_counter, start);
+    return 1;
+}
+
+static int push_semaphores(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    int pushed = 0;
+
+    // block for one free slot only, then take whatever else is free up to the rest of the batch,
+    // so producers never sit on tokens while waiting for more of them
+    while (pushed < n) {
+        if (!sem_wait_or_stop(&sync->free_space_sem, stop, ind, free_space_wait(stats))) break;
+
+        int claimed = 1;
+        while (pushed + claimed < n && sem_trywait(&sync->free_space_sem) == 0) claimed++;
+
+        stamp_messages(messages + pushed, claimed);
+
+        // the tokens already reserved the slots, the lock-free ring needs no mutex around the push;
+        // it can still miss while a consumer that claimed a cell earlier has not released it
+        if (sync->queue->lock_free) {
+            int done = 0;
+            while (done < claimed) {
+                int step = queue_push_n(messages + pushed + done, claimed - done, sync->queue);
+                if (step == 0) sched_yield();
+                done += step;
+            }
+        } else {
+            queue_sync_lock(sync, stats);
+            queue_push_n(messages + pushed, claimed, sync->queue);
+            queue_sync_unlock(sync, stats);
+        }
+
+        pushed += claimed;
+
+        // sem_post only enters the kernel when a consumer sleeps on items_sem
+        for (int i = 0; i < claimed; i++) {
+            sem_post(&sync->items_sem);
+        }
+    }
+
+    return pushed;
+}
+
+static int pop_semaphores(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    // block for the first message only, then take whatever else is already there up to n
+    if (!sem_wait_or_stop(&sync->items_sem, stop, ind, items_wait(stats))) return 0;
+
+    int claimed = 1;
+    while (claimed < n && sem_trywait(&sync->items_sem) == 0) claimed++;
+
+    int popped = 0;
+    int released = claimed;
+
+    if (sync->queue->lock_free) {
+        // items_sem only says a message is coming, its producer may still be filling the cell
+        while (popped < claimed) {
+            int step = queue_pop_n(messages + popped, claimed - popped, sync->queue);
+            if (step == 0) sched_yield();
+            popped += step;
+        }
+    } else {
+        queue_sync_lock(sync, stats);
+        popped = queue_pop_n(messages, claimed, sync->queue);
+        while (sync->shrink_debt > 0 && released > 0) {
+            sync->shrink_debt--;
+            released--;
+        }
+        queue_sync_unlock(sync, stats);
+    }
+
+    for (int i = 0; i < released; i++) {
+        sem_post(&sync->free_space_sem);
+    }
+
+    return popped;
+}
+
+
+// CONDVARS, SPIN-THEN-PARK AND SPIN
+
+// the caller holds queue_mutex; one wakeup per moved message
+static void signal_waiters(atomic_int* waiting, pthread_cond_t* cond, int moved) {
+    if (atomic_load(waiting) == 0) return;
+
+    if (moved > 1) {
+        pthread_cond_broadcast(cond);
+    } else {
+        pthread_cond_signal(cond);
+    }
+}
+
+// lock-free ring: the other side only takes queue_mutex when someone sleeps
+static void wake_waiters(queue_sync_t* sync, atomic_int* waiting, pthread_cond_t* cond, int moved, thread_stats_t* stats) {
+    if (atomic_load(waiting) == 0) return;
+
+    queue_sync_lock(sync, stats);
+    signal_waiters(waiting, cond, moved);
+    queue_sync_unlock(sync, stats);
+}
+
+// consumers only sleep on an empty queue, so only the empty -> non-empty step needs a wakeup;
+// a sleeper left behind while the queue stays non-empty is handed the baton by whoever sees it
+static int push_locked(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    message_queue_t* queue = sync->queue;
+    int limit = spin_limit(sync);
+    int pushed = 0;
+    int spins = 0;
+    uint64_t start = 0;
+
+    queue_sync_lock(sync, stats);
+    while (pushed < n) {
+        while (queue_is_full(queue)) {
+            if (stop(ind)) {
+                queue_sync_unlock(sync, stats);
+                count_wait(free_space_wait(stats), start);
+                return pushed;
+            }
+
+            start = wait_started(start);
+
+            if (spins < limit) {
+                spin_relock(sync, spins++);
+                continue;
+            }
+
+            atomic_fetch_add(&sync->producers_waiting, 1);
+            cond_wait(sync, &sync->free_space_cond, stats);
+            atomic_fetch_sub(&sync->producers_waiting, 1);
+        }
+
+        if (start) {
+            count_wait(free_space_wait(stats), start);
+            if (stats) lock_acquired_ns = bench_now_ns();
+            start = 0;
+        }
+
+        stamp_messages(messages + pushed, n - pushed);
+
+        int was_empty = queue_is_empty(queue);
+        int moved = queue_push_n(messages + pushed, n - pushed, queue);
+        pushed += moved;
+
+        if (was_empty) signal_waiters(&sync->consumers_waiting, &sync->items_cond, moved);
+    }
+
+    if (!queue_is_full(queue) && atomic_load(&sync->producers_waiting) > 0) {
+        pthread_cond_signal(&sync->free_space_cond);
+    }
+    queue_sync_unlock(sync, stats);
+
+    return pushed;
+}
+
+// mirror of push_locked: producers only sleep on a full queue
+static int pop_locked(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    message_queue_t* queue = sync->queue;
+    int limit = spin_limit(sync);
+    int spins = 0;
+    uint64_t start = 0;
+
+    queue_sync_lock(sync, stats);
+    while (queue_is_empty(queue)) {
+        if (stop(ind)) {
+            queue_sync_unlock(sync, stats);
+            count_wait(items_wait(stats), start);
+            return 0;
+        }
+
+        start = wait_started(start);
+
+        if (spins < limit) {
+            spin_relock(sync, spins++);
+            continue;
+        }
+
+        atomic_fetch_add(&sync->consumers_waiting, 1);
+        cond_wait(sync, &sync->items_cond, stats);
+        atomic_fetch_sub(&sync->consumers_waiting, 1);
+    }
+
+    if (start) {
+        count_wait(items_wait(stats), start);
+        if (stats) lock_acquired_ns = bench_now_ns();
+    }
+
+    int was_full = queue_is_full(queue);
+    int popped = queue_pop_n(messages, n, queue);
+
+    if (was_full) signal_waiters(&sync->producers_waiting, &sync->free_space_cond, popped);
+
+    if (!queue_is_empty(queue) && atomic_load(&sync->consumers_waiting) > 0) {
+        pthread_cond_signal(&sync->items_cond);
+    }
+    queue_sync_unlock(sync, stats);
+
+    return popped;
+}
+
+static int push_lock_free(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    message_queue_t* queue = sync->queue;
+    int limit = spin_limit(sync);
+    int pushed = 0;
+    int announced = 0;
+    int spins = 0;
+    uint64_t start = 0;
+
+    stamp_messages(messages, n);
+
+    while (pushed < n) {
+        int moved = queue_push_n(messages + pushed, n - pushed, queue);
+        pushed += moved;
+
+        if (moved > 0) continue;
+        if (stop(ind)) break;
+
+        start = wait_started(start);
+
+        if (spins < limit) {
+            spin_pause(spins++);
+            continue;
+        }
+
+        queue_sync_lock(sync, stats);
+
+        // a batch larger than the free room fills the ring first, its consumers must hear of it before this producer sleeps
+        if (pushed > announced) {
+            signal_waiters(&sync->consumers_waiting, &sync->items_cond, pushed - announced);
+            announced = pushed;
+        }
+
+        atomic_fetch_add(&sync->producers_waiting, 1);
+
+        while (queue_is_full(queue) && !stop(ind)) {
+            cond_wait(sync, &sync->free_space_cond, stats);
+        }
+
+        atomic_fetch_sub(&sync->producers_waiting, 1);
+        queue_sync_unlock(sync, stats);
+    }
+
+    count_wait(free_space_wait(stats), start);
+    if (pushed > announced) wake_waiters(sync, &sync->consumers_waiting, &sync->items_cond, pushed - announced, stats);
+
+    return pushed;
+}
+
+static int pop_lock_free(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    message_queue_t* queue = sync->queue;
+    int limit = spin_limit(sync);
+    int spins = 0;
+    int popped;
+    uint64_t start = 0;
+
+    while ((popped = queue_pop_n(messages, n, queue)) == 0) {
+        if (stop(ind)) break;
+
+        start = wait_started(start);
+
+        if (spins < limit) {
+            spin_pause(spins++);
+            continue;
+        }
+
+        queue_sync_lock(sync, stats);
+        atomic_fetch_add(&sync->consumers_waiting, 1);
+
+        while (queue_is_empty(queue) && !stop(ind)) {
+            cond_wait(sync, &sync->items_cond, stats);
+        }
+
+        atomic_fetch_sub(&sync->consumers_waiting, 1);
+        queue_sync_unlock(sync, stats);
+    }
+
+    count_wait(items_wait(stats), start);
+    wake_waiters(sync, &sync->producers_waiting, &sync->free_space_cond, popped, stats);
+
+    return popped;
+}
+
+
+// PUSH/POP
+
+// returns how many messages went in, fewer than n only when stop() asked the producer to leave
+int queue_sync_push(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    int pushed;
+
+    if (sync->strategy == SYNC_SEMAPHORES) {
+        pushed = push_semaphores(sync, messages, n, stop, ind, stats);
+    } else if (sync->queue->lock_free) {
+        pushed = push_lock_free(sync, messages, n, stop, ind, stats);
+    } else {
+        pushed = push_locked(sync, messages, n, stop, ind, stats);
+    }
+
+    if (stats) stats_add(&stats->pushes, pushed);
+
+    // reported only here, after queue_mutex is released, so critical sections hold nothing but queue operations
+    if (pushed > 0 && !sync->queue->quiet) {
+        if (pushed == 1) {
+            log_printf("\nQueue: message was pushed");
+        } else {
+            log_printf("\nQueue: %d messages were pushed", pushed);
+        }
+    }
+    return pushed;
+}
+
+// returns how many messages came out, 0 only when stop() asked the consumer to leave
+int queue_sync_pop(queue_sync_t* sync, message_queue_element_t** messages, int n, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    int popped;
+
+    if (sync->strategy == SYNC_SEMAPHORES) {
+        popped = pop_semaphores(sync, messages, n, stop, ind, stats);
+    } else if (sync->queue->lock_free) {
+        popped = pop_lock_free(sync, messages, n, stop, ind, stats);
+    } else {
+        popped = pop_locked(sync, messages, n, stop, ind, stats);
+    }
+
+    if (stats) stats_add(&stats->pops, popped);
+    return popped;
+}
+
+
+// RESIZE
+
+int queue_sync_resize(queue_sync_t* sync, int new_max_len) {
+    pthread_mutex_lock(&sync->queue_mutex);
+
+    int delta = new_max_len - sync->queue->max_len;
+    if (!queue_resize(sync->queue, new_max_len)) {
+        pthread_mutex_unlock(&sync->queue_mutex);
+        return 0;
+    }
+
+    if (sync->strategy != SYNC_SEMAPHORES) {
+        pthread_mutex_unlock(&sync->queue_mutex);
+
+        if (delta > 0) pthread_cond_broadcast(&sync->free_space_cond);
+        log_printf("\nQueue: resized, actual max-len = %d", new_max_len);
+        return 1;
+    }
+
+    while (delta > 0 && sync->shrink_debt > 0) {
+        sync->shrink_debt--;
+        delta--;
+    }
+
+    pthread_mutex_unlock(&sync->queue_mutex);
+
+    for (; delta > 0; delta--) {
+        sem_post(&sync->free_space_sem);
+    }
+
+    // take back the free slots that are available now, the rest is collected from consumers as they pop
+    while (delta < 0 && sem_trywait(&sync->free_space_sem) == 0) {
+        delta++;
+    }
+
+    if (delta < 0) {
+        pthread_mutex_lock(&sync->queue_mutex);
+        sync->shrink_debt -= delta;
+        pthread_mutex_unlock(&sync->queue_mutex);
+    }
+
+    log_printf("\nQueue: resized, actual max-len = %d", new_max_len);
+    return 1;
+}
+
+// a consistent len/max_len pair for observers outside the worker threads
+int queue_sync_depth(queue_sync_t* sync, int* max_len) {
+    pthread_mutex_lock(&sync->queue_mutex);
+    int depth = queue_len(sync->queue);
+    if (max_len) *max_len = sync->queue->max_len;
+    pthread_mutex_unlock(&sync->queue_mutex);
+
+    return depth;
+}
+
+// sleepers re-check their stop condition under queue_mutex, so a broadcast after it changed reaches all of them;
+// semaphore waiters notice on their next poll
+void queue_sync_wake_all(queue_sync_t* sync) {
+    pthread_mutex_lock(&sync->queue_mutex);
+    pthread_cond_broadcast(&sync->free_space_cond);
+    pthread_cond_broadcast(&sync->items_cond);
+    pthread_mutex_unlock(&sync->queue_mutex);
+}
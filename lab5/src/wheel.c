@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "./headers/wheel.h"
+#include "./headers/pool.h"
+
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+
+// WHEEL STATE (guarded by wheel_mutex)
+
+static pthread_mutex_t wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+// the wheel thread sleeps here until its next occupied tick, or until an earlier timer comes in
+static pthread_cond_t due_cond;
+// producers sleep here while WHEEL_MAX_PENDING messages are pending
+static pthread_cond_t space_cond;
+
+static queue_sync_t* ready_sync = NULL;
+static int copy_messages = 0;
+static atomic_int running = 0;
+static pthread_t wheel_thread;
+
+static uint64_t start_ns = 0;
+// every tick before now_tick has expired
+static uint64_t now_tick = 0;
+// the tick the wheel thread sleeps until: UINT64_MAX while it sleeps without a deadline, 0 while it is awake
+static uint64_t sleep_tick = 0;
+
+static wheel_timer_t* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+// one bit per non-empty slot, so the wheel thread finds its next deadline without scanning
+static uint64_t occupied[WHEEL_LEVELS];
+static int armed = 0;
+
+static wheel_timer_t* free_timers = NULL;
+static wheel_chunk_t* chunks = NULL;
+
+static wheel_stats_t wheel_stats = {0};
+
+// expired timers on their way to the ready queue, oldest tick first
+typedef struct {
+    wheel_timer_t* head;
+    wheel_timer_t* tail;
+} due_list_t;
+
+
+// TIMERS
+
+static wheel_timer_t* alloc_timer() {
+    if (!free_timers) {
+        wheel_chunk_t* chunk = malloc(sizeof(wheel_chunk_t));
+        if (!chunk) {
+            perror("Wheel: failed to allocate timers");
+            exit(EXIT_FAILURE);
+        }
+
+        chunk->next = chunks;
+        chunks = chunk;
+
+        for (int i = 0; i < WHEEL_CHUNK_TIMERS; i++) {
+            chunk->timers[i].next = free_timers;
+            free_timers = &chunk->timers[i];
+        }
+    }
+
+    wheel_timer_t* timer = free_timers;
+    free_timers = timer->next;
+
+    return timer;
+}
+
+static void release_timer(wheel_timer_t* timer) {
+    timer->next = free_timers;
+    free_timers = timer;
+}
+
+static uint64_t tick_ns(uint64_t tick) {
+    return start_ns + tick * WHEEL_TICK_NS;
+}
+
+// O(1): the level is picked from how far away the deadline is, the slot from the deadline itself
+static void insert_timer(wheel_timer_t* timer) {
+    uint64_t max_delta = (1ull << (WHEEL_SLOT_BITS * WHEEL_LEVELS)) - 1;
+
+    if (timer->due_tick < now_tick) timer->due_tick = now_tick;
+    if (timer->due_tick - now_tick > max_delta) timer->due_tick = now_tick + max_delta;
+
+    uint64_t delta = timer->due_tick - now_tick;
+    int level = delta ? (63 - __builtin_clzll(delta)) / WHEEL_SLOT_BITS : 0;
+    int slot = (timer->due_tick >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK;
+
+    timer->next = slots[level][slot];
+    slots[level][slot] = timer;
+    occupied[level] |= 1ull << slot;
+    armed++;
+}
+
+static wheel_timer_t* take_slot(int level, int slot) {
+    wheel_timer_t* list = slots[level][slot];
+
+    slots[level][slot] = NULL;
+    occupied[level] &= ~(1ull << slot);
+
+    return list;
+}
+
+// a slot of an upper level holds one round of the level below, it is spread over that level when the round starts
+static void cascade(int level, int slot) {
+    wheel_timer_t* timer = take_slot(level, slot);
+
+    while (timer) {
+        wheel_timer_t* next = timer->next;
+
+        armed--;
+        insert_timer(timer);
+        wheel_stats.cascaded++;
+
+        timer = next;
+    }
+}
+
+// expires now_tick onto the due list
+static void advance(due_list_t* due, uint64_t now_ns) {
+    uint64_t tick = now_tick;
+
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if (tick & ((1ull << (WHEEL_SLOT_BITS * level)) - 1)) break;
+        cascade(level, (tick >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK);
+    }
+
+    wheel_timer_t* timer = take_slot(0, tick & WHEEL_SLOT_MASK);
+    if (!timer) {
+        now_tick++;
+        return;
+    }
+
+    uint64_t lateness = now_ns > tick_ns(tick) ? now_ns - tick_ns(tick) : 0;
+
+    // a slot holds its newest timer first, turned around the tick leaves in push order
+    wheel_timer_t* ordered = NULL;
+    wheel_timer_t* last = timer;
+
+    while (timer) {
+        wheel_timer_t* next = timer->next;
+
+        armed--;
+        wheel_stats.expired++;
+        wheel_stats.lateness_ns += lateness;
+        if (lateness > wheel_stats.max_lateness_ns) wheel_stats.max_lateness_ns = lateness;
+
+        timer->next = ordered;
+        ordered = timer;
+
+        timer = next;
+    }
+
+    if (due->tail) {
+        due->tail->next = ordered;
+    } else {
+        due->head = ordered;
+    }
+    due->tail = last;
+
+    now_tick++;
+}
+
+// the next occupied slot of the current level-0 round, or the start of the next round, which may cascade timers down
+static uint64_t next_event_tick() {
+    if (armed == 0) return UINT64_MAX;
+
+    // a round that has not started yet still has to pull its timers down from the levels above
+    if ((now_tick & WHEEL_SLOT_MASK) == 0) return now_tick;
+
+    uint64_t ahead = occupied[0] >> (now_tick & WHEEL_SLOT_MASK);
+    if (ahead) return now_tick + __builtin_ctzll(ahead);
+
+    return (now_tick | WHEEL_SLOT_MASK) + 1;
+}
+
+
+// WHEEL THREAD
+
+static int wheel_stopped(int ind) {
+    (void)ind;
+    return !atomic_load(&running);
+}
+
+static void to_timespec(uint64_t ns, struct timespec* ts) {
+    ts->tv_sec = ns / 1000000000ull;
+    ts->tv_nsec = ns % 1000000000ull;
+}
+
+// due timers go to the ready queue in batches; the queue's wait strategy wakes consumers once per batch,
+// and only when the queue was empty
+static void deliver(wheel_timer_t* due) {
+    message_queue_element_t* batch[WHEEL_BATCH];
+    wheel_timer_t* timers[WHEEL_BATCH];
+
+    while (due) {
+        int n = 0;
+        while (due && n < WHEEL_BATCH) {
+            timers[n] = due;
+            batch[n] = copy_messages ? &due->copy : due->message;
+            due = due->next;
+            n++;
+        }
+
+        int pushed = queue_sync_push(ready_sync, batch, n, wheel_stopped, 0, NULL);
+
+        // only a stopping wheel leaves messages behind
+        if (!copy_messages) {
+            for (int i = pushed; i < n; i++) pool_free(batch[i]);
+        }
+
+        pthread_mutex_lock(&wheel_mutex);
+        for (int i = 0; i < n; i++) release_timer(timers[i]);
+
+        wheel_stats.delivered += pushed;
+        wheel_stats.dropped += n - pushed;
+        wheel_stats.batches++;
+        wheel_stats.pending -= n;
+        pthread_cond_broadcast(&space_cond);
+        pthread_mutex_unlock(&wheel_mutex);
+    }
+}
+
+static void* wheel_processing(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&wheel_mutex);
+    while (atomic_load(&running)) {
+        uint64_t now_ns = bench_now_ns();
+        uint64_t current = (now_ns - start_ns) / WHEEL_TICK_NS;
+        due_list_t due = {NULL, NULL};
+
+        while (now_tick <= current) advance(&due, now_ns);
+
+        if (due.head) {
+            pthread_mutex_unlock(&wheel_mutex);
+            deliver(due.head);
+            pthread_mutex_lock(&wheel_mutex);
+            continue;
+        }
+
+        sleep_tick = next_event_tick();
+        if (sleep_tick == UINT64_MAX) {
+            pthread_cond_wait(&due_cond, &wheel_mutex);
+        } else {
+            struct timespec deadline;
+            to_timespec(tick_ns(sleep_tick), &deadline);
+            pthread_cond_timedwait(&due_cond, &wheel_mutex, &deadline);
+        }
+        sleep_tick = 0;
+    }
+    pthread_mutex_unlock(&wheel_mutex);
+
+    pool_thread_flush();
+    return NULL;
+}
+
+
+// START/STOP
+
+void wheel_start(queue_sync_t* sync) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    // deadlines come from bench_now_ns, which is CLOCK_MONOTONIC
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    if (pthread_cond_init(&due_cond, &attr) != 0 || pthread_cond_init(&space_cond, &attr) != 0) {
+        perror("Wheel: conds creation failed");
+        exit(1);
+    }
+    pthread_condattr_destroy(&attr);
+
+    ready_sync = sync;
+    copy_messages = sync->queue->inline_storage;
+    start_ns = bench_now_ns();
+    now_tick = 0;
+    sleep_tick = 0;
+    memset(slots, 0, sizeof(slots));
+    memset(occupied, 0, sizeof(occupied));
+    armed = 0;
+    memset(&wheel_stats, 0, sizeof(wheel_stats));
+
+    atomic_store(&running, 1);
+    if (pthread_create(&wheel_thread, NULL, wheel_processing, NULL) != 0) {
+        perror("Wheel: failed to start the wheel thread");
+        exit(1);
+    }
+}
+
+// messages still waiting for their deadline are dropped
+void wheel_stop() {
+    if (!atomic_load(&running)) return;
+
+    pthread_mutex_lock(&wheel_mutex);
+    atomic_store(&running, 0);
+    pthread_cond_signal(&due_cond);
+    pthread_cond_broadcast(&space_cond);
+    pthread_mutex_unlock(&wheel_mutex);
+
+    // the wheel thread may sit in a full ready queue that nobody drains any more
+    queue_sync_wake_all(ready_sync);
+    pthread_join(wheel_thread, NULL);
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            for (wheel_timer_t* timer = take_slot(level, slot); timer; timer = timer->next) {
+                if (!copy_messages) pool_free(timer->message);
+                wheel_stats.dropped++;
+                wheel_stats.pending--;
+            }
+        }
+    }
+    armed = 0;
+
+    while (chunks) {
+        wheel_chunk_t* next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+    free_timers = NULL;
+
+    pthread_cond_destroy(&due_cond);
+    pthread_cond_destroy(&space_cond);
+}
+
+
+// PUSH
+
+// the message becomes visible to consumers once delay_ns has passed, never earlier;
+// returns 0 only when stop() asked the producer to leave while the wheel was full
+int wheel_push(message_queue_element_t* message, uint64_t delay_ns, sync_stop_t stop, int ind, thread_stats_t* stats) {
+    uint64_t now_ns = bench_now_ns();
+    uint64_t due_tick = (now_ns - start_ns + delay_ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS;
+    uint64_t wait_start = 0;
+
+    pthread_mutex_lock(&wheel_mutex);
+    while (wheel_stats.pending >= WHEEL_MAX_PENDING) {
+        if (stop(ind) || !atomic_load(&running)) {
+            pthread_mutex_unlock(&wheel_mutex);
+            if (stats && wait_start) stats_add(&stats->free_space_wait_ns, bench_now_ns() - wait_start);
+            return 0;
+        }
+
+        if (!wait_start) wait_start = bench_now_ns();
+
+        // stop() is polled like a semaphore wait, nobody broadcasts here when a producer is closed
+        struct timespec deadline;
+        to_timespec(bench_now_ns() + SYNC_STOP_POLL_NS, &deadline);
+        pthread_cond_timedwait(&space_cond, &wheel_mutex, &deadline);
+    }
+
+    wheel_timer_t* timer = alloc_timer();
+    timer->due_tick = due_tick;
+    if (copy_messages) {
+        timer->copy = *message;
+        timer->message = &timer->copy;
+    } else {
+        timer->message = message;
+    }
+    insert_timer(timer);
+
+    wheel_stats.scheduled++;
+    wheel_stats.pending++;
+    if (wheel_stats.pending > wheel_stats.peak_pending) wheel_stats.peak_pending = wheel_stats.pending;
+
+    // the wheel thread only needs waking when the new deadline is before the one it sleeps towards
+    if (timer->due_tick < sleep_tick) pthread_cond_signal(&due_cond);
+    pthread_mutex_unlock(&wheel_mutex);
+
+    if (stats) {
+        if (wait_start) stats_add(&stats->free_space_wait_ns, bench_now_ns() - wait_start);
+        stats_add(&stats->pushes, 1);
+    }
+
+    return 1;
+}
+
+
+// STATS
+
+void wheel_get_stats(wheel_stats_t* stats) {
+    pthread_mutex_lock(&wheel_mutex);
+    *stats = wheel_stats;
+    pthread_mutex_unlock(&wheel_mutex);
+}
+
+void wheel_print_stats() {
+    wheel_stats_t stats;
+    wheel_get_stats(&stats);
+
+    printf("\nWheel: scheduled %" PRIu64 ", delivered %" PRIu64 ", dropped %" PRIu64 ", pending %d (peak %d)",
+        stats.scheduled, stats.delivered, stats.dropped, stats.pending, stats.peak_pending);
+    printf("\n  (batches %" PRIu64 " ; %.1f messages each ; cascaded %" PRIu64 " ; lateness avg %.1f us, max %.1f us)",
+        stats.batches, stats.batches ? (double)stats.expired / stats.batches : 0.0, stats.cascaded,
+        stats.expired ? stats.lateness_ns / 1e3 / stats.expired : 0.0, stats.max_lateness_ns / 1e3);
+    printf("\n\t");
+}
@@ -15,11 +15,26 @@
 #include <inttypes.h>
 #include <limits.h>
 
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+/* below this many records qsort is as fast as building the histograms */
+#define RADIX_MIN_RECORDS 256
+/* widest in-memory merge, wider ones lose more to cache misses than they save in passes */
+#define MERGE_MAX_WAYS 16
+/* smallest input window of the external merge, in records */
+#define MERGE_MIN_WINDOW 512
+
 size_t g_memsize;           
 int g_block_count;        
 int g_thread_count;       
-int g_block_size;     
+uint64_t g_portion_records;
 int g_next_block = 0;      
+int g_merge_blocks;
+int g_merge_ways;
+int g_merge_parts;
+index_record *g_merge_src = NULL;
+index_record *g_merge_dst = NULL;
 
 pthread_mutex_t g_block_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_barrier_t g_barrier;
@@ -44,32 +59,253 @@ int cmp_index(const void *a, const void *b)
     return 0;
 }
 
-void merge_blocks(index_record *left, index_record *right, int nleft, int nright)
+/* flipping the sign bit of positive doubles and every bit of negative ones
+ * gives integers that order the same way as the doubles */
+static inline uint64_t radix_key(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t mask = -(bits >> 63) | 0x8000000000000000ull;
+    return bits ^ mask;
+}
+
+/* LSD radix sort on time_mark, tmp must hold count records. All histograms
+ * are built in one read of the block, and passes where every key has the
+ * same digit (the exponent bytes of close time marks) are skipped. */
+void radix_sort_block(index_record *block, uint64_t count, index_record *tmp)
+{
+    if (count < 2)
+        return;
+    static _Thread_local uint64_t hist[RADIX_PASSES][RADIX_BUCKETS];
+    memset(hist, 0, sizeof(hist));
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t key = radix_key(block[i].time_mark);
+        for (int pass = 0; pass < RADIX_PASSES; pass++)
+            hist[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    index_record *src = block;
+    index_record *dst = tmp;
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        int shift = pass * RADIX_BITS;
+        uint64_t *counts = hist[pass];
+        if (counts[(radix_key(block[0].time_mark) >> shift) & (RADIX_BUCKETS - 1)] == count)
+            continue;
+
+        uint64_t sum = 0;
+        for (int b = 0; b < RADIX_BUCKETS; b++) {
+            uint64_t c = counts[b];
+            counts[b] = sum;
+            sum += c;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t key = radix_key(src[i].time_mark);
+            dst[counts[(key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+        }
+        index_record *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != block)
+        memcpy(block, src, count * sizeof(index_record));
+}
+
+/* one sorted input of a k-way merge. A block in memory is a single window,
+ * a run on disk is read window by window into buf. */
+typedef struct {
+    index_record *pos;
+    index_record *end;
+    uint64_t key;
+    int exhausted;
+    int fd;
+    off_t next_offset;
+    uint64_t unread;
+    index_record *buf;
+    size_t buf_records;
+} merge_source;
+
+/* tree[0] holds the index of the current smallest source, tree[1..k-1] the
+ * loser of the match played at that node, so replacing the winner costs
+ * log2(k) comparisons along a single path */
+typedef struct {
+    int k;
+    int *tree;
+    merge_source *src;
+} loser_tree;
+
+void source_memory(merge_source *s, index_record *start, uint64_t count)
 {
-    int total = nleft + nright;
-    index_record *tmp = malloc(total * sizeof(index_record));
-    if (!tmp) {
-        perror("malloc merge");
-        exit(EXIT_FAILURE);
-    }
-    int i = 0, j = 0, k = 0;
-    while (i < nleft && j < nright) {
-        if (cmp_index(&left[i], &right[j]) <= 0)
-            tmp[k++] = left[i++];
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->pos = start;
+    s->end = start + count;
+    s->exhausted = count == 0;
+    if (count)
+        s->key = radix_key(start->time_mark);
+}
+
+int source_refill(merge_source *s)
+{
+    if (s->unread == 0) {
+        s->exhausted = 1;
+        return 0;
+    }
+    size_t want = s->unread < s->buf_records ? s->unread : s->buf_records;
+    size_t bytes = want * sizeof(index_record);
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t got = pread(s->fd, (char *)s->buf + done, bytes - done, s->next_offset + done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0) {
+            perror("pread in source_refill");
+            return -1;
+        }
+        done += got;
+    }
+    s->next_offset += bytes;
+    s->unread -= want;
+    s->pos = s->buf;
+    s->end = s->buf + want;
+    s->key = radix_key(s->pos->time_mark);
+    return 0;
+}
+
+static inline int source_less(const merge_source *src, int a, int b)
+{
+    if (src[a].exhausted)
+        return 0;
+    if (src[b].exhausted)
+        return 1;
+    return src[a].key < src[b].key;
+}
+
+int loser_tree_init(loser_tree *lt, merge_source *src, int k)
+{
+    lt->k = k;
+    lt->src = src;
+    lt->tree = malloc(k * sizeof(int));
+    int *winner = malloc(2 * k * sizeof(int));
+    if (!lt->tree || !winner) {
+        perror("malloc loser tree");
+        free(lt->tree);
+        free(winner);
+        return -1;
+    }
+    for (int i = 0; i < k; i++)
+        winner[k + i] = i;
+    for (int node = k - 1; node > 0; node--) {
+        int a = winner[2 * node];
+        int b = winner[2 * node + 1];
+        if (source_less(src, b, a)) {
+            winner[node] = b;
+            lt->tree[node] = a;
+        } else {
+            winner[node] = a;
+            lt->tree[node] = b;
+        }
+    }
+    lt->tree[0] = k > 1 ? winner[1] : 0;
+    free(winner);
+    return 0;
+}
+
+void loser_tree_free(loser_tree *lt)
+{
+    free(lt->tree);
+    lt->tree = NULL;
+}
+
+/* writes the next count records of the merge to out */
+int loser_tree_merge(loser_tree *lt, index_record *out, uint64_t count)
+{
+    merge_source *src = lt->src;
+    int *tree = lt->tree;
+    int k = lt->k;
+    for (uint64_t i = 0; i < count; i++) {
+        int w = tree[0];
+        merge_source *s = &src[w];
+        out[i] = *s->pos++;
+        if (s->pos < s->end)
+            s->key = radix_key(s->pos->time_mark);
+        else if (s->fd < 0)
+            s->exhausted = 1;
+        else if (source_refill(s) != 0)
+            return -1;
+        for (int node = (w + k) / 2; node > 0; node /= 2) {
+            if (source_less(src, tree[node], w)) {
+                int t = tree[node];
+                tree[node] = w;
+                w = t;
+            }
+        }
+        tree[0] = w;
+    }
+    return 0;
+}
+
+/* number of records of seq with a key below key, or not above it with or_equal */
+uint64_t key_rank(const index_record *seq, uint64_t len, uint64_t key, int or_equal)
+{
+    uint64_t lo = 0, hi = len;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        uint64_t k = radix_key(seq[mid].time_mark);
+        if (k < key || (or_equal && k == key))
+            lo = mid + 1;
         else
-            tmp[k++] = right[j++];
+            hi = mid;
     }
-    while (i < nleft)
-        tmp[k++] = left[i++];
-    while (j < nright)
-        tmp[k++] = right[j++];
-    memcpy(left, tmp, total * sizeof(index_record));
-    free(tmp);
+    return lo;
+}
+
+/* merge path over k sorted sequences: picks cut[i] records from each so that
+ * they add up to rank and none of them is above any record left behind. The
+ * smallest key with at least rank records not above it is found by binary
+ * search, records below it are taken and the ties filled in from the front. */
+void merge_split(index_record **seq, const uint64_t *len, int k, uint64_t rank, uint64_t *cut)
+{
+    uint64_t lo = 0, hi = UINT64_MAX;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        uint64_t count = 0;
+        for (int i = 0; i < k && count < rank; i++)
+            count += key_rank(seq[i], len[i], mid, 1);
+        if (count >= rank)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    uint64_t left = rank;
+    for (int i = 0; i < k; i++) {
+        cut[i] = key_rank(seq[i], len[i], lo, 0);
+        left -= cut[i];
+    }
+    for (int i = 0; i < k && left > 0; i++) {
+        uint64_t ties = key_rank(seq[i], len[i], lo, 1) - cut[i];
+        uint64_t take = ties < left ? ties : left;
+        cut[i] += take;
+        left -= take;
+    }
+}
+
+/* first record of block i of a portion cut into count blocks. Sizes differ
+ * by at most one record, and since counts are powers of two, merging
+ * neighbouring blocks keeps every boundary of the coarser cut. */
+uint64_t block_first(int i, int count)
+{
+    return g_portion_records * i / count;
 }
 
 void *thread_sort(void *arg)
 {
     (void)arg; 
+    /* scratch for the radix passes, taken with the first block this thread
+     * claims, so threads left without a block allocate nothing; without it
+     * the blocks go to qsort */
+    index_record *tmp = NULL;
+    int tmp_tried = 0;
     pthread_barrier_wait(&g_barrier);
 
     while (1) {
@@ -82,30 +318,66 @@ void *thread_sort(void *arg)
         pthread_mutex_unlock(&g_block_mutex);
         if (block_index == -1)
             break;
-        index_record *block_start = g_records + block_index * g_block_size;
-        qsort(block_start, g_block_size, sizeof(index_record), cmp_index);
+        uint64_t first = block_first(block_index, g_block_count);
+        uint64_t count = block_first(block_index + 1, g_block_count) - first;
+        uint64_t largest = (g_portion_records + g_block_count - 1) / g_block_count;
+        if (!tmp_tried && largest >= RADIX_MIN_RECORDS) {
+            tmp = malloc(largest * sizeof(index_record));
+            tmp_tried = 1;
+        }
+        if (tmp)
+            radix_sort_block(g_records + first, count, tmp);
+        else
+            qsort(g_records + first, count, sizeof(index_record), cmp_index);
     }
 
+    free(tmp);
     pthread_barrier_wait(&g_barrier);
     return NULL;
 }
 
+/* a task is one part of the output of one group, so a level with fewer
+ * groups than threads still keeps every thread busy */
 void *thread_merge(void *arg)
 {
     (void)arg;
+    merge_source src[MERGE_MAX_WAYS];
+    index_record *seq[MERGE_MAX_WAYS];
+    uint64_t len[MERGE_MAX_WAYS];
+    uint64_t from[MERGE_MAX_WAYS];
+    uint64_t to[MERGE_MAX_WAYS];
+    int groups = (g_merge_blocks + g_merge_ways - 1) / g_merge_ways;
     while (1) {
-        int merge_index = -1;
+        int task = -1;
         pthread_mutex_lock(&g_block_mutex);
-        if (g_next_block + 1 < g_block_count) {
-            merge_index = g_next_block;
-            g_next_block += 2;
+        if (g_next_block < groups * g_merge_parts) {
+            task = g_next_block;
+            g_next_block++;
         }
         pthread_mutex_unlock(&g_block_mutex);
-        if (merge_index == -1)
+        if (task == -1)
             break;        
-        index_record *left = g_records + merge_index * g_block_size;
-        index_record *right = g_records + (merge_index + 1) * g_block_size;
-        merge_blocks(left, right, g_block_size, g_block_size);
+        int merge_index = task / g_merge_parts * g_merge_ways;
+        int part = task % g_merge_parts;
+        int ways = g_merge_blocks - merge_index < g_merge_ways ? g_merge_blocks - merge_index : g_merge_ways;
+        uint64_t first = block_first(merge_index, g_merge_blocks);
+        uint64_t total = block_first(merge_index + ways, g_merge_blocks) - first;
+        for (int i = 0; i < ways; i++) {
+            uint64_t block = block_first(merge_index + i, g_merge_blocks);
+            seq[i] = g_merge_src + block;
+            len[i] = block_first(merge_index + i + 1, g_merge_blocks) - block;
+        }
+        uint64_t start = total * part / g_merge_parts;
+        uint64_t end = total * (part + 1) / g_merge_parts;
+        merge_split(seq, len, ways, start, from);
+        merge_split(seq, len, ways, end, to);
+        for (int i = 0; i < ways; i++)
+            source_memory(&src[i], seq[i] + from[i], to[i] - from[i]);
+        loser_tree lt;
+        if (loser_tree_init(&lt, src, ways) != 0)
+            exit(EXIT_FAILURE);
+        loser_tree_merge(&lt, g_merge_dst + first + start, end - start);
+        loser_tree_free(&lt);
     }
     pthread_barrier_wait(&g_barrier);
     return NULL;
@@ -152,13 +424,8 @@ int process_portion(const char *filename, off_t current_offset, size_t portion_b
 
     g_records = (index_record *)((char *)mapped_region + start_offset);
 
-    if (recs_in_portion % g_block_count != 0) {
-        fprintf(stderr, "Error: records in portion (%" PRIu64 ") not divisible by block count (%d)\n",
-                recs_in_portion, g_block_count);
-        munmap(mapped_region, map_length);
-        return -1;
-    }
-    g_block_size = recs_in_portion / g_block_count;
+    /* a short last portion gets as many blocks, just smaller and of uneven size */
+    g_portion_records = recs_in_portion;
 
     g_next_block = 0;
     pthread_barrier_init(&g_barrier, NULL, g_thread_count);
@@ -190,9 +457,26 @@ int process_portion(const char *filename, off_t current_offset, size_t portion_b
     free(tid_array);
     free(tid_arg);
 
+    /* every level merges from one buffer into the other */
+    index_record *scratch = NULL;
+    if (g_block_count > 1) {
+        scratch = malloc(recs_in_portion * sizeof(index_record));
+        if (!scratch) {
+            perror("malloc scratch in process_portion");
+            munmap(mapped_region, map_length);
+            return -1;
+        }
+    }
+    g_merge_src = g_records;
+    g_merge_dst = scratch;
+
     int current_block_count = g_block_count;
     while (current_block_count > 1) {
         g_next_block = 0;
+        g_merge_blocks = current_block_count;
+        g_merge_ways = current_block_count < MERGE_MAX_WAYS ? current_block_count : MERGE_MAX_WAYS;
+        int groups = (current_block_count + g_merge_ways - 1) / g_merge_ways;
+        g_merge_parts = (g_thread_count + groups - 1) / groups;
         pthread_barrier_init(&g_barrier, NULL, g_thread_count);
         
         tid_array = malloc(g_thread_count * sizeof(pthread_t));
@@ -200,6 +484,7 @@ int process_portion(const char *filename, off_t current_offset, size_t portion_b
         if (!tid_array || !tid_arg) {
             perror("malloc in merge phase");
             pthread_barrier_destroy(&g_barrier);
+            free(scratch);
             munmap(mapped_region, map_length);
             return -1;
         }
@@ -210,6 +495,7 @@ int process_portion(const char *filename, off_t current_offset, size_t portion_b
                 free(tid_array);
                 free(tid_arg);
                 pthread_barrier_destroy(&g_barrier);
+                free(scratch);
                 munmap(mapped_region, map_length);
                 return -1;
             }
@@ -221,10 +507,14 @@ int process_portion(const char *filename, off_t current_offset, size_t portion_b
         free(tid_array);
         free(tid_arg);
         
-        current_block_count /= 2;
-        g_block_count = current_block_count;
-        g_block_size *= 2;
+        current_block_count = (current_block_count + g_merge_ways - 1) / g_merge_ways;
+        index_record *swap = g_merge_src;
+        g_merge_src = g_merge_dst;
+        g_merge_dst = swap;
     }
+    if (g_merge_src != g_records)
+        memcpy(g_records, g_merge_src, recs_in_portion * sizeof(index_record));
+    free(scratch);
 
     if (msync(mapped_region, map_length, MS_SYNC) < 0) {
         perror("msync in process_portion");
@@ -239,52 +529,299 @@ int process_portion(const char *filename, off_t current_offset, size_t portion_b
     return 0;
 }
 
-int external_merge(const char *filename, run_boundary *runs, int run_count)
+int pwrite_all(int fd, const void *data, size_t bytes, off_t offset)
 {
-    while (run_count > 1) {
-        int new_run_count = 0;
-        for (int i = 0; i < run_count; i += 2) {
-            if (i + 1 == run_count) {
-                runs[new_run_count++] = runs[i];
-            } else {
-                off_t merge_offset = runs[i].offset;
-                uint64_t total_recs = runs[i].nrecords + runs[i+1].nrecords;
-                size_t merge_size = total_recs * sizeof(index_record);
-                
-                int pagesize = getpagesize();
-                off_t map_offset = merge_offset - (merge_offset % pagesize);
-                size_t map_length = merge_size + (merge_offset - map_offset);
-                
-                int fd = open(filename, O_RDWR);
-                if (fd < 0) {
-                    perror("open in external_merge");
-                    return -1;
-                }
-                void *mapped_region = mmap(NULL, map_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map_offset);
-                if (mapped_region == MAP_FAILED) {
-                    perror("mmap in external_merge");
-                    close(fd);
-                    return -1;
-                }
-                close(fd);
-                index_record *ptr = (index_record *)((char *)mapped_region + (merge_offset - map_offset));
-                merge_blocks(ptr, ptr + runs[i].nrecords, runs[i].nrecords, runs[i+1].nrecords);
-                if (msync(mapped_region, map_length, MS_SYNC) < 0) {
-                    perror("msync in external_merge");
-                    munmap(mapped_region, map_length);
-                    return -1;
-                }
-                munmap(mapped_region, map_length);
-                runs[new_run_count].offset = runs[i].offset;
-                runs[new_run_count].nrecords = total_recs;
-                new_run_count++;
-            }
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t put = pwrite(fd, (const char *)data + done, bytes - done, offset + done);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put < 0) {
+            perror("pwrite in external_merge");
+            return -1;
         }
-        run_count = new_run_count;
+        done += put;
     }
     return 0;
 }
 
+/* one thread's share of the external merge: records from[i]..to[i] of every
+ * run, written to the scratch file at out_offset and later copied back to the
+ * same offset of the index file */
+typedef struct {
+    int fd;
+    int out_fd;
+    run_boundary *runs;
+    int run_count;
+    uint64_t *from;
+    uint64_t *to;
+    off_t out_offset;
+    size_t out_bytes;
+    size_t window;
+    int rc;
+} merge_part;
+
+void *thread_external_merge(void *arg)
+{
+    merge_part *part = arg;
+    int k = part->run_count;
+    size_t window = part->window;
+    part->rc = -1;
+
+    index_record *buffers = malloc((size_t)(k + 1) * window * sizeof(index_record));
+    merge_source *src = calloc(k, sizeof(merge_source));
+    loser_tree lt = {0, NULL, NULL};
+    if (!buffers || !src) {
+        perror("malloc in thread_external_merge");
+        free(buffers);
+        free(src);
+        return NULL;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < k; i++) {
+        src[i].fd = part->fd;
+        src[i].next_offset = part->runs[i].offset + part->from[i] * sizeof(index_record);
+        src[i].unread = part->to[i] - part->from[i];
+        src[i].buf = buffers + i * window;
+        src[i].buf_records = window;
+        if (source_refill(&src[i]) != 0)
+            goto out;
+        total += part->to[i] - part->from[i];
+    }
+    index_record *out_buf = buffers + k * window;
+
+    if (loser_tree_init(&lt, src, k) != 0)
+        goto out;
+    off_t offset = part->out_offset;
+    while (total > 0) {
+        uint64_t n = total < window ? total : window;
+        if (loser_tree_merge(&lt, out_buf, n) != 0)
+            goto out;
+        if (pwrite_all(part->out_fd, out_buf, n * sizeof(index_record), offset) != 0)
+            goto out;
+        offset += n * sizeof(index_record);
+        total -= n;
+    }
+    part->rc = 0;
+
+out:
+    loser_tree_free(&lt);
+    free(src);
+    free(buffers);
+    return NULL;
+}
+
+void *thread_copy_back(void *arg)
+{
+    merge_part *part = arg;
+    off_t in = part->out_offset;
+    off_t out = part->out_offset;
+    size_t left = part->out_bytes;
+    part->rc = -1;
+
+    while (left > 0) {
+        ssize_t done = copy_file_range(part->out_fd, &in, part->fd, &out, left, 0);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            break;
+        left -= done;
+    }
+
+    /* file systems without copy_file_range between these two files go through the window */
+    index_record *buf = left > 0 ? malloc(part->window * sizeof(index_record)) : NULL;
+    if (left > 0 && !buf) {
+        perror("malloc in thread_copy_back");
+        return NULL;
+    }
+    while (left > 0) {
+        size_t bytes = part->window * sizeof(index_record);
+        if (bytes > left)
+            bytes = left;
+        ssize_t got = pread(part->out_fd, buf, bytes, in);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0) {
+            perror("pread in thread_copy_back");
+            free(buf);
+            return NULL;
+        }
+        if (pwrite_all(part->fd, buf, got, out) != 0) {
+            free(buf);
+            return NULL;
+        }
+        in += got;
+        out += got;
+        left -= got;
+    }
+    free(buf);
+    part->rc = 0;
+    return NULL;
+}
+
+/* runs fn on every part in its own thread, -1 if a thread could not start or a part failed */
+int run_parts(void *(*fn)(void *), merge_part *parts, int nparts)
+{
+    pthread_t *tid_array = malloc(nparts * sizeof(pthread_t));
+    if (!tid_array) {
+        perror("malloc in run_parts");
+        return -1;
+    }
+    int started = 0;
+    for (int p = 0; p < nparts; p++) {
+        if (pthread_create(&tid_array[p], NULL, fn, &parts[p]) != 0) {
+            perror("pthread_create in run_parts");
+            break;
+        }
+        started++;
+    }
+    for (int p = 0; p < started; p++)
+        pthread_join(tid_array[p], NULL);
+    free(tid_array);
+    if (started < nparts)
+        return -1;
+    for (int p = 0; p < nparts; p++) {
+        if (parts[p].rc != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* an unnamed file next to the index file, gone as soon as it is closed */
+int open_scratch(const char *filename)
+{
+    char dir[PATH_MAX];
+    const char *slash = strrchr(filename, '/');
+    if (!slash)
+        snprintf(dir, sizeof(dir), ".");
+    else if (slash == filename)
+        snprintf(dir, sizeof(dir), "/");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - filename), filename);
+
+    int fd = open(dir, O_TMPFILE | O_RDWR, 0600);
+    if (fd >= 0)
+        return fd;
+
+    char name[PATH_MAX];
+    if (snprintf(name, sizeof(name), "%s.mergeXXXXXX", filename) >= (int)sizeof(name)) {
+        fprintf(stderr, "Error: file name too long\n");
+        return -1;
+    }
+    fd = mkstemp(name);
+    if (fd < 0) {
+        perror("mkstemp in external_merge");
+        return -1;
+    }
+    unlink(name);
+    return fd;
+}
+
+/* one pass over all runs: the output is cut into one range per thread by
+ * merge_split over the runs mapped read-only, each thread reads its pieces of
+ * the runs through its own windows and writes its range to a scratch file,
+ * then copies it back over the runs. Every record is read and written twice,
+ * the index file keeps its inode, and the scratch file takes as much disk as
+ * the records for the time of the merge. It is never synced and is dropped
+ * right after, so its pages mostly die in the page cache. */
+int external_merge(const char *filename, run_boundary *runs, int run_count)
+{
+    int rc = -1;
+    int scratch_fd = -1;
+    void *mapped = MAP_FAILED;
+    index_record **seq = NULL;
+    uint64_t *len = NULL;
+    uint64_t *cuts = NULL;
+    merge_part *parts = NULL;
+
+    int fd = open(filename, O_RDWR);
+    if (fd < 0) {
+        perror("open in external_merge");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat in external_merge");
+        goto out;
+    }
+    mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        perror("mmap in external_merge");
+        goto out;
+    }
+
+    int nparts = g_thread_count;
+    seq = malloc(run_count * sizeof(index_record *));
+    len = malloc(run_count * sizeof(uint64_t));
+    cuts = malloc((size_t)(nparts + 1) * run_count * sizeof(uint64_t));
+    parts = malloc(nparts * sizeof(merge_part));
+    if (!seq || !len || !cuts || !parts) {
+        perror("malloc in external_merge");
+        goto out;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < run_count; i++) {
+        seq[i] = (index_record *)((char *)mapped + runs[i].offset);
+        len[i] = runs[i].nrecords;
+        total += runs[i].nrecords;
+    }
+    for (int p = 0; p <= nparts; p++)
+        merge_split(seq, len, run_count, total * p / nparts, cuts + (size_t)p * run_count);
+
+    scratch_fd = open_scratch(filename);
+    if (scratch_fd < 0)
+        goto out;
+
+    /* memsize is shared by the input windows and the output buffer of every thread */
+    size_t window = g_memsize / sizeof(index_record) / (run_count + 1) / nparts;
+    window -= window % MERGE_MIN_WINDOW;
+    if (window < MERGE_MIN_WINDOW)
+        window = MERGE_MIN_WINDOW;
+
+    off_t data_start = runs[0].offset;
+    for (int p = 0; p < nparts; p++) {
+        uint64_t start = total * p / nparts;
+        uint64_t end = total * (p + 1) / nparts;
+        parts[p].fd = fd;
+        parts[p].out_fd = scratch_fd;
+        parts[p].runs = runs;
+        parts[p].run_count = run_count;
+        parts[p].from = cuts + (size_t)p * run_count;
+        parts[p].to = cuts + (size_t)(p + 1) * run_count;
+        parts[p].out_offset = data_start + start * sizeof(index_record);
+        parts[p].out_bytes = (end - start) * sizeof(index_record);
+        parts[p].window = window;
+    }
+
+    /* every run must be read in full before any range is written back */
+    if (run_parts(thread_external_merge, parts, nparts) != 0)
+        goto out;
+    munmap(mapped, st.st_size);
+    mapped = MAP_FAILED;
+    if (run_parts(thread_copy_back, parts, nparts) != 0)
+        goto out;
+
+    if (fsync(fd) < 0) {
+        perror("fsync in external_merge");
+        goto out;
+    }
+    rc = 0;
+
+out:
+    free(parts);
+    free(cuts);
+    free(len);
+    free(seq);
+    if (mapped != MAP_FAILED)
+        munmap(mapped, st.st_size);
+    if (scratch_fd >= 0)
+        close(scratch_fd);
+    close(fd);
+    return rc;
+}
+
 int main(int argc, char *argv[])
 {
     if (argc != 5) {